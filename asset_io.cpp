@@ -0,0 +1,104 @@
+﻿#include "asset_io.h"
+
+#include <filesystem>
+#include <iostream>
+
+#include "thread_pool.h"
+
+asset_io& asset_io::instance()
+{
+    static asset_io io;
+    return io;
+}
+
+void asset_io::prefetch(const std::vector<std::string>& paths)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (const auto& path : paths)
+    {
+        if (prefetched_.count(path) != 0)
+            continue;
+
+        prefetched_.emplace(path, thread_pool::shared().submit([this, path]
+        {
+            auto file = map(path);
+            file->prefetch();
+            return file;
+        }).share());
+    }
+}
+
+void asset_io::release_prefetched()
+{
+    // jobs still in flight keep their view alive until they finish, dropping the futures doesn't wait for them
+    std::lock_guard<std::mutex> lock(mutex_);
+    prefetched_.clear();
+}
+
+std::shared_ptr<const mapped_file> asset_io::open(const std::string& path)
+{
+    std::shared_future<std::shared_ptr<const mapped_file>> pending;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        const auto it = prefetched_.find(path);
+        if (it != prefetched_.end())
+            pending = it->second;
+    }
+
+    // a worker must not wait for a prefetch job that may still be queued behind it, it maps the file itself
+    if (pending.valid() && (!thread_pool::shared().is_worker_thread() ||
+        pending.wait_for(std::chrono::seconds(0)) == std::future_status::ready))
+    {
+        auto file = pending.get();
+        if (file->is_open())
+        {
+            ++prefetch_hits_;
+            return file;
+        }
+    }
+
+    return map(path);
+}
+
+bool asset_io::exists(const std::string& path)
+{
+    ++extra_system_calls_;
+    std::error_code error;
+    return std::filesystem::exists(path, error);
+}
+
+void asset_io::add_bytes_copied(const size_t size)
+{
+    bytes_copied_ += size;
+}
+
+asset_io_statistics asset_io::get_statistics() const
+{
+    asset_io_statistics statistics;
+    statistics.files_opened = files_opened_;
+    statistics.prefetch_hits = prefetch_hits_;
+    statistics.system_calls = mapped_file::get_system_call_count() + extra_system_calls_;
+    statistics.bytes_mapped = bytes_mapped_;
+    statistics.bytes_copied = bytes_copied_;
+    return statistics;
+}
+
+void asset_io::report(const std::string& label) const
+{
+    const auto statistics = get_statistics();
+    std::cout << "ASSET_IO::" << label << " " << statistics.files_opened << " files mapped (" <<
+        statistics.prefetch_hits << " prefetch hits), " << statistics.system_calls << " system calls, " <<
+        statistics.bytes_mapped / 1024 << " KiB mapped, " << statistics.bytes_copied / 1024 << " KiB copied" <<
+        std::endl;
+}
+
+std::shared_ptr<const mapped_file> asset_io::map(const std::string& path)
+{
+    auto file = std::make_shared<const mapped_file>(path);
+    if (file->is_open())
+    {
+        ++files_opened_;
+        bytes_mapped_ += file->size();
+    }
+    return file;
+}
@@ -0,0 +1,62 @@
+﻿#pragma once
+#include <atomic>
+#include <cstddef>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "mapped_file.h"
+
+// Totals since the start of the process, see asset_io::report()
+struct asset_io_statistics
+{
+    size_t files_opened = 0;
+    size_t prefetch_hits = 0;
+    size_t system_calls = 0;
+    size_t bytes_mapped = 0;
+    // bytes a reader copied out of a mapping into its own buffer, see asset_io::add_bytes_copied()
+    size_t bytes_copied = 0;
+};
+
+// All asset file reads go through here. Files are memory mapped and shared as read-only views, so the image decoder,
+// Assimp and the shader compiler read straight from the page cache instead of from a copy. prefetch() maps a batch
+// of files on thread_pool::shared() and reads their pages in ahead of time, so the disk reads of the startup set
+// overlap with each other and with the rest of the startup instead of happening one file after the other.
+class asset_io
+{
+public:
+    static asset_io& instance();
+
+    // Starts mapping and reading the files in the background. Missing files are skipped silently, the load that
+    // needs them reports the error.
+    void prefetch(const std::vector<std::string>& paths);
+    // forgets the prefetched views, they stay mapped only while still in use; call once the startup set is loaded
+    void release_prefetched();
+
+    // The prefetched view of the file or a newly mapped one, check is_open(). Outside the pool this waits for a
+    // prefetch still in flight, on a pool worker it maps the file again instead.
+    std::shared_ptr<const mapped_file> open(const std::string& path);
+    // a file system query that does not map the file, counted as one system call
+    bool exists(const std::string& path);
+
+    void add_bytes_copied(size_t size);
+    asset_io_statistics get_statistics() const;
+    // prints the statistics as ASSET_IO::<label>
+    void report(const std::string& label) const;
+
+private:
+    std::mutex mutex_;
+    std::unordered_map<std::string, std::shared_future<std::shared_ptr<const mapped_file>>> prefetched_;
+    std::atomic<size_t> files_opened_{0};
+    std::atomic<size_t> prefetch_hits_{0};
+    std::atomic<size_t> extra_system_calls_{0};
+    std::atomic<size_t> bytes_mapped_{0};
+    std::atomic<size_t> bytes_copied_{0};
+
+    asset_io() = default;
+
+    std::shared_ptr<const mapped_file> map(const std::string& path);
+};
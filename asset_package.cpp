@@ -0,0 +1,339 @@
+﻿#include "asset_package.h"
+
+#include <cstring>
+#include <filesystem>
+#include <iostream>
+
+#include "asset_io.h"
+#include "binary_io.h"
+#include "hash.h"
+
+namespace
+{
+    constexpr char package_magic[4] = {'L', 'O', 'G', 'P'};
+
+    struct package_header
+    {
+        char magic[4];
+        std::uint32_t version;
+        std::uint64_t params_hash;
+        std::uint64_t source_key;
+        std::uint32_t input_count;
+        std::uint32_t entry_count;
+    };
+
+    struct texture_header
+    {
+        std::uint32_t width;
+        std::uint32_t height;
+        std::uint32_t channels;
+        std::uint32_t level_count;
+        // block_format, none for plain 8-bit texels
+        std::uint32_t format;
+        std::uint32_t reserved;
+        std::uint64_t content_hash;
+    };
+
+    struct texture_level_header
+    {
+        std::uint32_t width;
+        std::uint32_t height;
+        std::uint64_t size;
+    };
+}
+
+bool cooked_texture::is_valid() const
+{
+    return !levels.empty();
+}
+
+std::string asset_package::get_path(const std::string& source_path)
+{
+    auto relative = std::filesystem::path(source_path).lexically_normal().relative_path();
+    return std::string(directory) + '/' + relative.generic_string() + ".pkg";
+}
+
+std::uint64_t asset_package::make_source_key(const std::vector<std::string>& inputs, const std::uint64_t params_hash)
+{
+    std::uint64_t key = hash_value(version);
+    key = hash_value(params_hash, key);
+
+    for (const auto& input : inputs)
+    {
+        // through asset_io, so inputs prefetched for the check are not read a second time
+        const auto file = asset_io::instance().open(input);
+        if (!file->is_open())
+            return 0;
+        key = hash_string(input, key);
+        key = hash_bytes(file->data(), file->size(), key);
+    }
+
+    return key;
+}
+
+bool asset_package::is_up_to_date(const std::string& package_path, const std::uint64_t params_hash)
+{
+    const asset_package package(package_path);
+    return package.is_valid() && package.params_hash_ == params_hash && package.are_inputs_unchanged();
+}
+
+asset_package::asset_package(const std::string& path) :
+    file_(asset_io::instance().open(path)), valid_(false), params_hash_(0), source_key_(0), has_meshes_(false)
+{
+    if (file_->is_open())
+        valid_ = parse();
+}
+
+bool asset_package::is_valid() const
+{
+    return valid_;
+}
+
+std::uint64_t asset_package::get_params_hash() const
+{
+    return params_hash_;
+}
+
+bool asset_package::are_inputs_unchanged() const
+{
+    const auto key = make_source_key(inputs_, params_hash_);
+    return key != 0 && key == source_key_;
+}
+
+const std::vector<std::string>& asset_package::get_inputs() const
+{
+    return inputs_;
+}
+
+const unsigned char* asset_package::find(const std::string& name, size_t& size) const
+{
+    const auto it = entries_.find(name);
+    if (it == entries_.end())
+        return nullptr;
+
+    size = it->second.second;
+    return it->second.first;
+}
+
+bool asset_package::contains(const std::string& name) const
+{
+    return entries_.count(name) != 0;
+}
+
+bool asset_package::has_meshes() const
+{
+    return has_meshes_;
+}
+
+const std::vector<cached_mesh>& asset_package::get_meshes() const
+{
+    return meshes_;
+}
+
+cooked_texture asset_package::get_texture(const std::string& name) const
+{
+    cooked_texture texture;
+    size_t size = 0;
+    const auto data = find(name, size);
+    if (!data)
+        return texture;
+
+    binary_reader reader(data, size);
+    texture_header header{};
+    if (!reader.read_value(header))
+        return texture;
+
+    const auto format = static_cast<block_format>(header.format);
+    if (header.format > static_cast<std::uint32_t>(block_format::bc7))
+        return texture;
+
+    std::vector<texture_level_header> level_headers(header.level_count);
+    for (auto& level_header : level_headers)
+    {
+        if (!reader.read_value(level_header))
+            return texture;
+    }
+
+    std::vector<cooked_texture::level> levels;
+    for (const auto& level_header : level_headers)
+    {
+        if (!reader.skip_to(binary_data_alignment))
+            return texture;
+        const auto pixels = reader.read(static_cast<size_t>(level_header.size));
+        const std::uint64_t expected_size = format == block_format::none
+            ? static_cast<std::uint64_t>(level_header.width) * level_header.height * header.channels
+            : get_compressed_size(format, static_cast<int>(level_header.width), static_cast<int>(level_header.height));
+        if (!pixels || level_header.size < expected_size)
+            return texture;
+        levels.push_back({
+            static_cast<int>(level_header.width), static_cast<int>(level_header.height), pixels,
+            static_cast<size_t>(level_header.size)
+        });
+    }
+
+    texture.channels = static_cast<int>(header.channels);
+    texture.format = format;
+    texture.content_hash = header.content_hash;
+    texture.levels = std::move(levels);
+    return texture;
+}
+
+bool asset_package::parse()
+{
+    binary_reader reader(file_->data(), file_->size());
+
+    package_header header{};
+    if (!reader.read_value(header) || std::memcmp(header.magic, package_magic, sizeof package_magic) != 0 ||
+        header.version != version)
+        return false;
+    params_hash_ = header.params_hash;
+    source_key_ = header.source_key;
+
+    for (std::uint32_t i = 0; i < header.input_count; ++i)
+    {
+        std::string input;
+        if (!reader.read_string(input))
+            return false;
+        inputs_.push_back(std::move(input));
+    }
+
+    for (std::uint32_t i = 0; i < header.entry_count; ++i)
+    {
+        std::string name;
+        std::uint64_t size;
+        if (!reader.read_string(name) || !reader.read_value(size) || !reader.skip_to(binary_data_alignment))
+            return false;
+        const auto data = reader.read(static_cast<size_t>(size));
+        if (!data)
+            return false;
+        entries_[name] = {data, static_cast<size_t>(size)};
+    }
+
+    size_t meshes_size = 0;
+    const auto meshes_data = find("meshes", meshes_size);
+    if (meshes_data)
+    {
+        // the meshes stay in the mapping, exactly like mesh cache hits
+        if (!mesh_cache::deserialize(meshes_data, meshes_size, params_hash_, meshes_))
+            return false;
+        has_meshes_ = true;
+    }
+
+    return true;
+}
+
+void asset_package_writer::add_input(const std::string& path)
+{
+    for (const auto& input : inputs_)
+    {
+        if (input == path)
+            return;
+    }
+    inputs_.push_back(path);
+}
+
+void asset_package_writer::add_entry(const std::string& name, std::vector<unsigned char> data)
+{
+    entries_.emplace_back(name, std::move(data));
+}
+
+void asset_package_writer::add_meshes(const std::vector<mesh_data>& meshes, const std::uint64_t params_hash)
+{
+    add_entry("meshes", mesh_cache::serialize(params_hash, meshes));
+}
+
+std::vector<unsigned char> asset_package_writer::make_texture_entry(const image& image)
+{
+    if (!image.is_valid())
+        return {};
+
+    cooked_texture texture;
+    texture.channels = image.channels;
+    texture.content_hash = image.content_hash;
+    texture.levels.push_back({
+        image.width, image.height, image.pixels.get(),
+        static_cast<size_t>(image.width) * image.height * image.channels
+    });
+    for (const auto& level : image.mip_levels)
+        texture.levels.push_back({level.width, level.height, level.pixels.data(), level.pixels.size()});
+    return make_texture_entry(texture);
+}
+
+std::vector<unsigned char> asset_package_writer::make_texture_entry(const compressed_image& image)
+{
+    cooked_texture texture;
+    texture.channels = image.channels;
+    texture.format = image.format;
+    texture.content_hash = image.content_hash;
+    for (const auto& level : image.levels)
+        texture.levels.push_back({level.width, level.height, level.blocks.data(), level.blocks.size()});
+    return make_texture_entry(texture);
+}
+
+std::vector<unsigned char> asset_package_writer::make_texture_entry(const cooked_texture& texture)
+{
+    std::vector<unsigned char> data;
+    if (!texture.is_valid())
+        return data;
+
+    binary_writer writer(data);
+    const texture_header header = {
+        static_cast<std::uint32_t>(texture.levels[0].width), static_cast<std::uint32_t>(texture.levels[0].height),
+        static_cast<std::uint32_t>(texture.channels), static_cast<std::uint32_t>(texture.levels.size()),
+        static_cast<std::uint32_t>(texture.format), 0, texture.content_hash
+    };
+    writer.write_value(header);
+
+    for (const auto& level : texture.levels)
+    {
+        writer.write_value(texture_level_header{
+            static_cast<std::uint32_t>(level.width), static_cast<std::uint32_t>(level.height), level.size
+        });
+    }
+
+    for (const auto& level : texture.levels)
+    {
+        writer.pad_to(binary_data_alignment);
+        writer.write(level.pixels, level.size);
+    }
+
+    return data;
+}
+
+bool asset_package_writer::write(const std::string& path, const std::uint64_t params_hash) const
+{
+    const auto source_key = asset_package::make_source_key(inputs_, params_hash);
+    if (source_key == 0)
+        std::cout << "ERROR::ASSET_PACKAGE::INPUT_NOT_READ " << path << std::endl;
+
+    std::vector<unsigned char> buffer;
+    binary_writer writer(buffer);
+
+    package_header header{};
+    std::memcpy(header.magic, package_magic, sizeof package_magic);
+    header.version = asset_package::version;
+    header.params_hash = params_hash;
+    header.source_key = source_key;
+    header.input_count = static_cast<std::uint32_t>(inputs_.size());
+    header.entry_count = static_cast<std::uint32_t>(entries_.size());
+    writer.write_value(header);
+
+    for (const auto& input : inputs_)
+        writer.write_string(input);
+
+    for (const auto& entry : entries_)
+    {
+        writer.write_string(entry.first);
+        writer.write_value(static_cast<std::uint64_t>(entry.second.size()));
+        writer.pad_to(binary_data_alignment);
+        writer.write(entry.second.data(), entry.second.size());
+    }
+
+    if (!write_file_atomically(path, buffer))
+    {
+        std::cout << "ERROR::ASSET_PACKAGE::FILE_NOT_WRITTEN " << path << std::endl;
+        return false;
+    }
+
+    return true;
+}
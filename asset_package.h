@@ -0,0 +1,104 @@
+﻿#pragma once
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "image.h"
+#include "mapped_file.h"
+#include "mesh_cache.h"
+#include "texture_compression.h"
+
+// Texture in upload-ready layout, level 0 first: tightly packed 8-bit rows (upload with GL_UNPACK_ALIGNMENT 1) or,
+// with a block format, the compressed blocks. The pixels point into the package it was read from.
+struct cooked_texture
+{
+    struct level
+    {
+        int width;
+        int height;
+        const unsigned char* pixels;
+        size_t size;
+    };
+
+    int channels = 0;
+    block_format format = block_format::none;
+    // same value decode_image() produces for the source file, so cooked and decoded textures dedupe together
+    std::uint64_t content_hash = 0;
+    std::vector<level> levels;
+
+    bool is_valid() const;
+};
+
+// Output of the asset cooker for one model or cubemap: named, 16 byte aligned blobs in a single file that is memory
+// mapped at runtime, so loading a cooked asset needs neither Assimp nor an image decoder. The package also records
+// its input files and a hash of their contents, which lets the cooker skip assets that have not changed.
+//
+// Entries: "meshes" holds mesh_cache::serialize() output keyed by the params hash, "texture/<path>" a cooked
+// texture, with <path> as referenced by the meshes.
+class asset_package
+{
+public:
+    // bump whenever the layout of the package or of its entries changes, or the processing that produces them
+    static constexpr std::uint32_t version = 3;
+    static constexpr const char* directory = "./cooked";
+
+    // where the package cooked from source_path lives, e.g. ./cooked/assets/grass/grass.obj.pkg
+    static std::string get_path(const std::string& source_path);
+    // hash of the package version, the parameters and the inputs' paths and contents; 0 if an input can't be read
+    static std::uint64_t make_source_key(const std::vector<std::string>& inputs, std::uint64_t params_hash);
+    // true if the package exists and was cooked with these parameters from the current contents of its inputs
+    static bool is_up_to_date(const std::string& package_path, std::uint64_t params_hash);
+
+    explicit asset_package(const std::string& path);
+
+    bool is_valid() const;
+    std::uint64_t get_params_hash() const;
+    // false once an input was changed or removed after cooking; reads all of the inputs
+    bool are_inputs_unchanged() const;
+    const std::vector<std::string>& get_inputs() const;
+
+    // returns nullptr if there is no such entry
+    const unsigned char* find(const std::string& name, size_t& size) const;
+    bool contains(const std::string& name) const;
+
+    bool has_meshes() const;
+    const std::vector<cached_mesh>& get_meshes() const;
+    // returns an invalid texture if the entry is missing or malformed
+    cooked_texture get_texture(const std::string& name) const;
+
+private:
+    std::shared_ptr<const mapped_file> file_;
+    bool valid_;
+    std::uint64_t params_hash_;
+    std::uint64_t source_key_;
+    std::vector<std::string> inputs_;
+    std::unordered_map<std::string, std::pair<const unsigned char*, size_t>> entries_;
+    std::vector<cached_mesh> meshes_;
+    bool has_meshes_;
+
+    bool parse();
+};
+
+class asset_package_writer
+{
+public:
+    // a file the package is cooked from; the package is out of date once any of them changes
+    void add_input(const std::string& path);
+    void add_entry(const std::string& name, std::vector<unsigned char> data);
+    void add_meshes(const std::vector<mesh_data>& meshes, std::uint64_t params_hash);
+
+    // Texture entries for add_entry(), built separately so the cooker can serialize textures on worker threads.
+    // An image is stored with whatever levels it carries, see generate_mipmaps(). Empty for an invalid texture.
+    static std::vector<unsigned char> make_texture_entry(const image& image);
+    static std::vector<unsigned char> make_texture_entry(const compressed_image& image);
+    static std::vector<unsigned char> make_texture_entry(const cooked_texture& texture);
+
+    bool write(const std::string& path, std::uint64_t params_hash) const;
+
+private:
+    std::vector<std::string> inputs_;
+    std::vector<std::pair<std::string, std::vector<unsigned char>>> entries_;
+};
@@ -0,0 +1,130 @@
+﻿#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <string>
+#include <vector>
+
+// Helpers for the flat binary files written at import and cook time (mesh cache, asset packages).
+// Data blocks are aligned so that they can be used in place once the file is memory mapped.
+
+constexpr size_t binary_data_alignment = 16;
+
+inline size_t align_up(const size_t value, const size_t alignment)
+{
+    return (value + alignment - 1) / alignment * alignment;
+}
+
+class binary_writer
+{
+public:
+    explicit binary_writer(std::vector<unsigned char>& buffer) : buffer_(buffer)
+    {
+    }
+
+    void write(const void* data, const size_t size)
+    {
+        const auto bytes = static_cast<const unsigned char*>(data);
+        buffer_.insert(buffer_.end(), bytes, bytes + size);
+    }
+
+    template <typename T>
+    void write_value(const T& value)
+    {
+        write(&value, sizeof(T));
+    }
+
+    void write_string(const std::string& value)
+    {
+        write_value(static_cast<std::uint32_t>(value.size()));
+        write(value.data(), value.size());
+    }
+
+    void pad_to(const size_t alignment)
+    {
+        buffer_.resize(align_up(buffer_.size(), alignment), 0);
+    }
+
+private:
+    std::vector<unsigned char>& buffer_;
+};
+
+class binary_reader
+{
+public:
+    binary_reader(const unsigned char* data, const size_t size) : data_(data), size_(size), offset_(0)
+    {
+    }
+
+    // returns nullptr if fewer than size bytes are left
+    const unsigned char* read(const size_t size)
+    {
+        if (size > size_ - offset_)
+            return nullptr;
+        const auto result = data_ + offset_;
+        offset_ += size;
+        return result;
+    }
+
+    template <typename T>
+    bool read_value(T& value)
+    {
+        const auto data = read(sizeof(T));
+        if (!data)
+            return false;
+        std::memcpy(&value, data, sizeof(T));
+        return true;
+    }
+
+    bool read_string(std::string& value)
+    {
+        std::uint32_t length;
+        if (!read_value(length))
+            return false;
+
+        const auto string_data = read(length);
+        if (!string_data)
+            return false;
+        value.assign(reinterpret_cast<const char*>(string_data), length);
+        return true;
+    }
+
+    bool skip_to(const size_t alignment)
+    {
+        return read(align_up(offset_, alignment) - offset_) != nullptr;
+    }
+
+private:
+    const unsigned char* data_;
+    size_t size_;
+    size_t offset_;
+};
+
+// Writes a temporary file next to path and renames it into place, so a reader mapping path never sees a partial
+// file. Creates missing parent directories.
+inline bool write_file_atomically(const std::string& path, const std::vector<unsigned char>& data)
+{
+    std::error_code error;
+    const auto parent = std::filesystem::path(path).parent_path();
+    if (!parent.empty())
+        std::filesystem::create_directories(parent, error);
+
+    const auto temp_path = path + ".tmp";
+    {
+        std::ofstream stream(temp_path, std::ios::binary | std::ios::trunc);
+        stream.write(reinterpret_cast<const char*>(data.data()), static_cast<std::streamsize>(data.size()));
+        if (!stream)
+            return false;
+    }
+
+    std::filesystem::rename(temp_path, path, error);
+    if (error)
+    {
+        std::filesystem::remove(temp_path, error);
+        return false;
+    }
+
+    return true;
+}
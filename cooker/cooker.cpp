@@ -0,0 +1,128 @@
+﻿// Offline asset cooker: turns the source assets listed in a manifest into the packages under ./cooked that the
+// renderer maps at startup instead of running Assimp and the image decoders. Run it from the directory the renderer
+// runs in; assets whose inputs and options have not changed since the last run are skipped.
+//
+// usage: cooker [manifest], the manifest defaults to ./assets/assets.cook
+#include <chrono>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "../cubemap.h"
+#include "../model.h"
+#include "../profiler.h"
+
+namespace
+{
+    bool parse_model_option(const std::string& option, model_params& params)
+    {
+        if (option == "clamp")
+            params.texture_clamp = true;
+        else if (option == "no_flip")
+            params.texture_flip = false;
+        else if (option == "batch")
+            params.batch_meshes = true;
+        else if (option == "weld")
+            params.weld_vertices = true;
+        else if (option == "optimize")
+            params.optimize_meshes = true;
+        else if (option == "compact")
+            params.compact_vertices = true;
+        else if (option == "meshlets")
+            params.build_meshlets = true;
+        else if (option == "compress")
+            params.compress_textures = true;
+        else if (option.compare(0, 5, "lods=") == 0)
+            return static_cast<bool>(std::istringstream(option.substr(5)) >> params.lod_count);
+        else
+            return false;
+        return true;
+    }
+
+    bool cook_line(const std::string& line, const size_t line_number)
+    {
+        std::istringstream tokens(line);
+        std::string kind;
+        tokens >> kind;
+
+        if (kind == "model")
+        {
+            std::string path, option;
+            tokens >> path;
+            model_params params;
+            while (tokens >> option)
+            {
+                if (!parse_model_option(option, params))
+                {
+                    std::cout << "ERROR::COOKER::UNKNOWN_OPTION " << option << " (line " << line_number << ")" <<
+                        std::endl;
+                    return false;
+                }
+            }
+            return !path.empty() && model::cook(path, params);
+        }
+
+        if (kind == "cubemap")
+        {
+            std::string faces[cubemap::sides];
+            for (auto& face : faces)
+                tokens >> face;
+            std::string option;
+            bool flip = false, compress = false;
+            while (tokens >> option)
+            {
+                if (option == "flip")
+                    flip = true;
+                else if (option == "compress")
+                    compress = true;
+                else
+                {
+                    std::cout << "ERROR::COOKER::UNKNOWN_OPTION " << option << " (line " << line_number << ")" <<
+                        std::endl;
+                    return false;
+                }
+            }
+            return !faces[cubemap::sides - 1].empty() && cubemap::cook(faces, flip, compress);
+        }
+
+        std::cout << "ERROR::COOKER::UNKNOWN_ASSET_KIND " << kind << " (line " << line_number << ")" << std::endl;
+        return false;
+    }
+}
+
+int main(const int argc, char* argv[])
+{
+    const std::string manifest_path = argc > 1 ? argv[1] : "./assets/assets.cook";
+    std::ifstream manifest(manifest_path);
+    if (!manifest)
+    {
+        std::cout << "ERROR::COOKER::MANIFEST_NOT_FOUND " << manifest_path << std::endl;
+        return 1;
+    }
+
+    const auto start_time = std::chrono::steady_clock::now();
+    size_t asset_count = 0, failed_count = 0;
+
+    std::string line;
+    for (size_t line_number = 1; std::getline(manifest, line); ++line_number)
+    {
+        const auto first = line.find_first_not_of(" \t\r");
+        if (first == std::string::npos || line[first] == '#')
+            continue;
+
+        ++asset_count;
+        if (!cook_line(line, line_number))
+        {
+            ++failed_count;
+            std::cout << "ERROR::COOKER::FAILED " << line << std::endl;
+        }
+    }
+
+    const std::chrono::duration<double, std::milli> cook_time = std::chrono::steady_clock::now() - start_time;
+    std::cout << "COOKER::DONE " << asset_count - failed_count << "/" << asset_count << " assets in " <<
+        cook_time.count() << " ms" << std::endl;
+    profiler::instance().print_summary("COOK");
+    return failed_count == 0 ? 0 : 1;
+}
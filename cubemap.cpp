@@ -1,39 +1,131 @@
 ﻿#include "cubemap.h"
 
+#include <algorithm>
+#include <atomic>
+#include <future>
 #include <iostream>
+#include <limits>
+#include <memory>
 
-#include "stb_image.h"
+#include "asset_io.h"
+#include "asset_package.h"
+#include "hash.h"
+#include "image.h"
+#include "mipmap.h"
+#include "profiler.h"
+#include "texture_compression.h"
+#include "thread_pool.h"
 
-cubemap::cubemap(const std::string texture_faces_paths[sides], const bool flip_vertically): texture_id_(0)
+namespace
 {
-    glGenTextures(1, &texture_id_);
-    glBindTexture(GL_TEXTURE_CUBE_MAP, texture_id_);
-
-    int width, height, num_channels;
+    GLenum get_face_format(const int channels)
+    {
+        return channels == 1 ? GL_RED : channels == 2 ? GL_RG : channels == 4 ? GL_RGBA : GL_RGB;
+    }
 
-    stbi_set_flip_vertically_on_load(flip_vertically);
+    // uploads the face with its mip levels, returns the number of levels
+    size_t upload_face(const unsigned int face, const image& image)
+    {
+        profile_scope scope("upload");
+        const GLenum target = GL_TEXTURE_CUBE_MAP_POSITIVE_X + face;
+        const GLenum format = get_face_format(image.channels);
+        glTexImage2D(target, 0, static_cast<GLint>(format), image.width, image.height, 0, format, GL_UNSIGNED_BYTE,
+                     image.pixels.get());
+        for (size_t level = 0; level < image.mip_levels.size(); ++level)
+        {
+            const auto& data = image.mip_levels[level];
+            glTexImage2D(target, static_cast<GLint>(level + 1), static_cast<GLint>(format), data.width, data.height, 0,
+                         format, GL_UNSIGNED_BYTE, data.pixels.data());
+        }
+        return image.mip_levels.size() + 1;
+    }
 
-    for (unsigned int i = 0; i < sides; i++)
+    size_t upload_face(const unsigned int face, const cooked_texture& texture)
     {
-        auto path = texture_faces_paths[i];
-        const auto filename = path.c_str();
-        const auto data = stbi_load(filename, &width, &height, &num_channels, 0);
-        if (data)
+        // without driver support the blocks are decoded here, which is still cheaper than decoding the JPEG
+        if (texture.format != block_format::none && !is_block_format_supported(texture.format))
+            return upload_face(face, decompress_texture(texture));
+
+        profile_scope scope("upload");
+        const GLenum target = GL_TEXTURE_CUBE_MAP_POSITIVE_X + face;
+        const GLenum format = get_face_format(texture.channels);
+        for (size_t level = 0; level < texture.levels.size(); ++level)
         {
-            glTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + i,
-                         0, GL_RGB, width, height, 0, GL_RGB, GL_UNSIGNED_BYTE, data
-            );
+            const auto& data = texture.levels[level];
+            if (texture.format != block_format::none)
+            {
+                glCompressedTexImage2D(target, static_cast<GLint>(level), get_gl_internal_format(texture.format),
+                                       data.width, data.height, 0, static_cast<GLsizei>(data.size), data.pixels);
+            }
+            else
+            {
+                glTexImage2D(target, static_cast<GLint>(level), static_cast<GLint>(format), data.width, data.height, 0,
+                             format, GL_UNSIGNED_BYTE, data.pixels);
+            }
         }
-        else
+        return texture.levels.size();
+    }
+}
+
+cubemap::cubemap(const std::string texture_faces_paths[sides], const bool flip_vertically, const bool compressed):
+    texture_id_(0)
+{
+    const auto package_path = get_package_path(texture_faces_paths);
+    profile_scope scope("load", package_path);
+    glGenTextures(1, &texture_id_);
+    glBindTexture(GL_TEXTURE_CUBE_MAP, texture_id_);
+
+    const asset_package package(package_path);
+    const auto params_hash = get_params_hash(texture_faces_paths, flip_vertically, compressed);
+    // the package is also the runtime cache, a face edited in place has to invalidate it like the mesh cache
+    bool use_package = package.is_valid() && package.get_params_hash() == params_hash;
+    if (use_package && !package.are_inputs_unchanged())
+    {
+        std::cout << "CUBEMAP::CACHE_STALE " << package_path << std::endl;
+        use_package = false;
+    }
+    cooked_texture cooked_faces[sides];
+    for (unsigned int i = 0; i < sides && use_package; i++)
+    {
+        cooked_faces[i] = package.get_texture(get_face_entry_name(i));
+        use_package = cooked_faces[i].is_valid();
+    }
+
+    // cooked rows and levels are tightly packed
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    size_t level_count = std::numeric_limits<size_t>::max();
+    if (use_package)
+    {
+        for (unsigned int i = 0; i < sides; i++)
+            level_count = std::min(level_count, upload_face(i, cooked_faces[i]));
+    }
+    else
+    {
+        auto faces = std::make_shared<std::vector<image>>(decode_faces(texture_faces_paths, flip_vertically));
+        for (unsigned int i = 0; i < sides; i++)
         {
-            std::cout << "Cubemap tex failed to load at path: " + path << std::endl;
+            const auto& face = (*faces)[i];
+            if (face.is_valid())
+                level_count = std::min(level_count, upload_face(i, face));
+            else
+                std::cout << "Cubemap tex failed to load at path: " + texture_faces_paths[i] << std::endl;
         }
 
-        stbi_image_free(data);
+        // cache the assembled cubemap, the next start then maps it with a single read instead of decoding
+        std::vector<std::string> paths(texture_faces_paths, texture_faces_paths + sides);
+        thread_pool::shared().submit([paths, faces, flip_vertically, compressed]
+        {
+            if (write_package(paths.data(), *faces, flip_vertically, compressed))
+                std::cout << "CUBEMAP::CACHED " << get_package_path(paths.data()) << std::endl;
+        });
     }
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
 
+    if (level_count == std::numeric_limits<size_t>::max())
+        level_count = 1;
+    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAX_LEVEL, static_cast<GLint>(level_count - 1));
     glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MIN_FILTER, level_count > 1 ? GL_LINEAR_MIPMAP_LINEAR : GL_LINEAR);
     glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
     glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
     glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
@@ -41,6 +133,34 @@ cubemap::cubemap(const std::string texture_faces_paths[sides], const bool flip_v
     glBindTexture(GL_TEXTURE_CUBE_MAP, 0);
 }
 
+bool cubemap::cook(const std::string texture_faces_paths[sides], const bool flip_vertically, const bool compressed)
+{
+    const auto package_path = get_package_path(texture_faces_paths);
+    const auto params_hash = get_params_hash(texture_faces_paths, flip_vertically, compressed);
+    if (asset_package::is_up_to_date(package_path, params_hash))
+    {
+        std::cout << "COOK::UP_TO_DATE " << package_path << std::endl;
+        return true;
+    }
+
+    if (!write_package(texture_faces_paths, decode_faces(texture_faces_paths, flip_vertically), flip_vertically,
+                       compressed))
+        return false;
+
+    std::cout << "COOK::COOKED " << package_path << std::endl;
+    return true;
+}
+
+std::vector<std::string> cubemap::get_input_files(const std::string texture_faces_paths[sides])
+{
+    // the faces are read either way, to decode them or to check the package is still current
+    std::vector<std::string> files(texture_faces_paths, texture_faces_paths + sides);
+    auto package_path = get_package_path(texture_faces_paths);
+    if (asset_io::instance().exists(package_path))
+        files.insert(files.begin(), std::move(package_path));
+    return files;
+}
+
 void cubemap::bind() const
 {
     glBindTexture(GL_TEXTURE_CUBE_MAP, texture_id_);
@@ -50,3 +170,90 @@ GLuint cubemap::get_id() const
 {
     return texture_id_;
 }
+
+std::string cubemap::get_package_path(const std::string texture_faces_paths[sides])
+{
+    const auto& first_face = texture_faces_paths[0];
+    return asset_package::get_path(first_face.substr(0, first_face.find_last_of('/')) + "/cubemap");
+}
+
+std::uint64_t cubemap::get_params_hash(const std::string texture_faces_paths[sides], const bool flip_vertically,
+                                       const bool compressed)
+{
+    std::uint64_t hash = hash_value(flip_vertically);
+    hash = hash_value(compressed, hash);
+    hash = hash_value(face_layout_version, hash);
+    for (unsigned int i = 0; i < sides; i++)
+        hash = hash_string(texture_faces_paths[i], hash);
+    return hash;
+}
+
+std::string cubemap::get_face_entry_name(const unsigned int face)
+{
+    return "face/" + std::to_string(face);
+}
+
+std::vector<image> cubemap::decode_faces(const std::string texture_faces_paths[sides], const bool flip_vertically)
+{
+    // shared with the jobs, which may only start after the faces are done if the pool is busy with other loads
+    struct decode_state
+    {
+        std::string paths[sides];
+        bool flip_vertically = false;
+        std::atomic<unsigned int> next_face{0};
+        image faces[sides];
+        std::promise<void> decoded[sides];
+    };
+
+    const auto decode_next_face = [](decode_state& state)
+    {
+        const unsigned int face = state.next_face++;
+        if (face >= sides)
+            return false;
+
+        state.faces[face] = decode_image(state.paths[face], state.flip_vertically);
+        generate_mipmaps(state.faces[face], true);
+        state.decoded[face].set_value();
+        return true;
+    };
+
+    const auto state = std::make_shared<decode_state>();
+    std::copy(texture_faces_paths, texture_faces_paths + sides, state->paths);
+    state->flip_vertically = flip_vertically;
+    for (unsigned int i = 1; i < sides; i++)
+        thread_pool::shared().submit([state, decode_next_face] { decode_next_face(*state); });
+
+    // this thread takes faces as well, so it never waits for a job still queued behind other work
+    while (decode_next_face(*state))
+    {
+    }
+
+    std::vector<image> faces;
+    for (unsigned int i = 0; i < sides; i++)
+    {
+        state->decoded[i].get_future().wait();
+        faces.push_back(std::move(state->faces[i]));
+    }
+    return faces;
+}
+
+bool cubemap::write_package(const std::string texture_faces_paths[sides], const std::vector<image>& faces,
+                            const bool flip_vertically, const bool compressed)
+{
+    asset_package_writer writer;
+    for (unsigned int i = 0; i < sides; i++)
+    {
+        writer.add_input(texture_faces_paths[i]);
+        const auto& face = faces[i];
+        if (!face.is_valid())
+            continue;
+
+        auto entry = compressed
+            ? asset_package_writer::make_texture_entry(compress_image(face, choose_block_format(face)))
+            : asset_package_writer::make_texture_entry(face);
+        writer.add_entry(get_face_entry_name(i), std::move(entry));
+    }
+
+    return writer.write(get_package_path(texture_faces_paths),
+                        get_params_hash(texture_faces_paths, flip_vertically, compressed));
+}
@@ -1,7 +1,10 @@
 ﻿#pragma once
+#include <cstdint>
 #include <string>
+#include <vector>
 #include <glad/glad.h>
 
+#include "image.h"
 #include "mesh.h"
 
 class cubemap
@@ -9,11 +12,37 @@ class cubemap
 public:
     static constexpr size_t sides = 6;
 
-    explicit cubemap(const std::string texture_faces_paths[sides], bool flip_vertically = false);
+    // Uses the cooked package of the faces if there is one that was cooked with the same options from the current
+    // face files, see cook().
+    // Otherwise the faces are decoded in parallel, with mip chains, and the package is written in the background,
+    // so the next start maps the whole cubemap with a single read.
+    explicit cubemap(const std::string texture_faces_paths[sides], bool flip_vertically = false,
+                     bool compressed = false);
+
+    // Decodes the faces and their mip levels into an asset package next to the other cooked assets, unless it is up
+    // to date. Compressed faces are stored as BC1 (BC3 with alpha) and decompressed again at load time on drivers
+    // without S3TC. Needs no GL context.
+    static bool cook(const std::string texture_faces_paths[sides], bool flip_vertically = false,
+                     bool compressed = false);
+
+    // the files loading the cubemap starts by reading, for asset_io::prefetch()
+    static std::vector<std::string> get_input_files(const std::string texture_faces_paths[sides]);
 
     void bind() const;
     GLuint get_id() const;
 
 private:
+    // part of the params hash, packages with faces in an older layout (without mip levels) are cooked again
+    static constexpr std::uint32_t face_layout_version = 2;
+
     GLuint texture_id_;
+
+    static std::string get_package_path(const std::string texture_faces_paths[sides]);
+    static std::uint64_t get_params_hash(const std::string texture_faces_paths[sides], bool flip_vertically,
+                                         bool compressed);
+    static std::string get_face_entry_name(unsigned int face);
+    // decodes the six faces and generates their mip chains concurrently on thread_pool::shared()
+    static std::vector<image> decode_faces(const std::string texture_faces_paths[sides], bool flip_vertically);
+    static bool write_package(const std::string texture_faces_paths[sides], const std::vector<image>& faces,
+                              bool flip_vertically, bool compressed);
 };
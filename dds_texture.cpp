@@ -0,0 +1,177 @@
+﻿#include "dds_texture.h"
+
+#include <algorithm>
+#include <cctype>
+#include <cstdint>
+#include <iostream>
+
+#include "asset_io.h"
+#include "binary_io.h"
+#include "hash.h"
+
+namespace
+{
+    constexpr std::uint32_t dds_magic = 0x20534444; // "DDS "
+    constexpr std::uint32_t pixel_format_four_cc = 0x4;
+    constexpr std::uint32_t caps2_cubemap = 0x200;
+    constexpr std::uint32_t dxgi_dimension_texture2d = 3;
+
+    constexpr std::uint32_t make_four_cc(const char a, const char b, const char c, const char d)
+    {
+        return static_cast<std::uint32_t>(a) | static_cast<std::uint32_t>(b) << 8 |
+            static_cast<std::uint32_t>(c) << 16 | static_cast<std::uint32_t>(d) << 24;
+    }
+
+    struct dds_pixel_format
+    {
+        std::uint32_t size;
+        std::uint32_t flags;
+        std::uint32_t four_cc;
+        std::uint32_t rgb_bit_count;
+        std::uint32_t bit_masks[4];
+    };
+
+    struct dds_header
+    {
+        std::uint32_t size;
+        std::uint32_t flags;
+        std::uint32_t height;
+        std::uint32_t width;
+        std::uint32_t pitch_or_linear_size;
+        std::uint32_t depth;
+        std::uint32_t mip_map_count;
+        std::uint32_t reserved1[11];
+        dds_pixel_format pixel_format;
+        std::uint32_t caps;
+        std::uint32_t caps2;
+        std::uint32_t caps3;
+        std::uint32_t caps4;
+        std::uint32_t reserved2;
+    };
+
+    struct dds_header_dx10
+    {
+        std::uint32_t dxgi_format;
+        std::uint32_t resource_dimension;
+        std::uint32_t misc_flag;
+        std::uint32_t array_size;
+        std::uint32_t misc_flags2;
+    };
+
+    static_assert(sizeof(dds_header) == 124, "DDS header layout");
+
+    block_format get_four_cc_format(const std::uint32_t four_cc)
+    {
+        if (four_cc == make_four_cc('D', 'X', 'T', '1'))
+            return block_format::bc1;
+        if (four_cc == make_four_cc('D', 'X', 'T', '5'))
+            return block_format::bc3;
+        if (four_cc == make_four_cc('A', 'T', 'I', '2') || four_cc == make_four_cc('B', 'C', '5', 'U'))
+            return block_format::bc5;
+        return block_format::none;
+    }
+
+    block_format get_dxgi_format(const std::uint32_t dxgi_format)
+    {
+        switch (dxgi_format)
+        {
+        case 71: // DXGI_FORMAT_BC1_UNORM
+        case 72: // DXGI_FORMAT_BC1_UNORM_SRGB
+            return block_format::bc1;
+        case 77: // DXGI_FORMAT_BC3_UNORM
+        case 78: // DXGI_FORMAT_BC3_UNORM_SRGB
+            return block_format::bc3;
+        case 83: // DXGI_FORMAT_BC5_UNORM
+            return block_format::bc5;
+        case 98: // DXGI_FORMAT_BC7_UNORM
+        case 99: // DXGI_FORMAT_BC7_UNORM_SRGB
+            return block_format::bc7;
+        default:
+            return block_format::none;
+        }
+    }
+}
+
+dds_texture::dds_texture(const std::string& path) : file_(asset_io::instance().open(path))
+{
+    if (!file_->is_open())
+    {
+        std::cout << "Texture failed to load at path: " << path << " (can't open file)" << std::endl;
+        return;
+    }
+
+    if (!parse())
+    {
+        texture_ = cooked_texture();
+        std::cout << "ERROR::DDS::UNSUPPORTED " << path <<
+            " (only 2D BC1, BC3, BC5 and BC7 textures can be loaded)" << std::endl;
+    }
+}
+
+bool dds_texture::is_valid() const
+{
+    return texture_.is_valid();
+}
+
+const cooked_texture& dds_texture::get_texture() const
+{
+    return texture_;
+}
+
+bool dds_texture::parse()
+{
+    binary_reader reader(file_->data(), file_->size());
+    std::uint32_t magic = 0;
+    dds_header header{};
+    if (!reader.read_value(magic) || magic != dds_magic || !reader.read_value(header) ||
+        header.size != sizeof(dds_header) || (header.caps2 & caps2_cubemap) != 0 ||
+        (header.pixel_format.flags & pixel_format_four_cc) == 0)
+        return false;
+
+    auto format = get_four_cc_format(header.pixel_format.four_cc);
+    if (header.pixel_format.four_cc == make_four_cc('D', 'X', '1', '0'))
+    {
+        dds_header_dx10 header_dx10{};
+        if (!reader.read_value(header_dx10) || header_dx10.resource_dimension != dxgi_dimension_texture2d ||
+            header_dx10.array_size > 1)
+            return false;
+        format = get_dxgi_format(header_dx10.dxgi_format);
+    }
+    if (format == block_format::none || header.width == 0 || header.height == 0)
+        return false;
+
+    texture_.format = format;
+    texture_.channels = format == block_format::bc5 ? 2 : 4;
+    texture_.content_hash = hash_bytes(file_->data(), file_->size());
+
+    // levels follow each other without padding, down to 1x1 unless the file stops earlier
+    const std::uint32_t level_count = std::max<std::uint32_t>(header.mip_map_count, 1);
+    int width = static_cast<int>(header.width);
+    int height = static_cast<int>(header.height);
+    for (std::uint32_t level = 0; level < level_count; ++level)
+    {
+        const auto size = get_compressed_size(format, width, height);
+        const auto blocks = reader.read(size);
+        if (!blocks)
+            return false;
+
+        texture_.levels.push_back({width, height, blocks, size});
+        if (width == 1 && height == 1)
+            break;
+        width = std::max(width / 2, 1);
+        height = std::max(height / 2, 1);
+    }
+
+    return true;
+}
+
+bool is_dds_file(const std::string& path)
+{
+    if (path.size() < 4)
+        return false;
+
+    std::string extension = path.substr(path.size() - 4);
+    std::transform(extension.begin(), extension.end(), extension.begin(),
+                   [](const unsigned char c) { return static_cast<char>(std::tolower(c)); });
+    return extension == ".dds";
+}
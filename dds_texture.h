@@ -0,0 +1,26 @@
+﻿#pragma once
+#include <memory>
+#include <string>
+
+#include "asset_package.h"
+#include "mapped_file.h"
+
+// Memory mapped DDS file holding a block compressed 2D texture (BC1, BC3, BC5 or BC7, legacy or DX10 header) with
+// its mip levels. The levels of get_texture() point into the mapping, so the object has to outlive the upload.
+// DDS stores the top row first and is used as is, texture_flip does not apply to it.
+class dds_texture
+{
+public:
+    explicit dds_texture(const std::string& path);
+
+    bool is_valid() const;
+    const cooked_texture& get_texture() const;
+
+private:
+    std::shared_ptr<const mapped_file> file_;
+    cooked_texture texture_;
+
+    bool parse();
+};
+
+bool is_dds_file(const std::string& path);
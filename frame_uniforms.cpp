@@ -0,0 +1,62 @@
+﻿#include "frame_uniforms.h"
+
+#include <cstddef>
+
+static_assert(offsetof(frame_block, viewport_size) == 8, "std140 layout of Frame");
+static_assert(sizeof(frame_block) == 16, "std140 layout of Frame");
+static_assert(offsetof(camera_block, projection) == 64, "std140 layout of Camera");
+static_assert(offsetof(camera_block, position) == 128, "std140 layout of Camera");
+static_assert(sizeof(directional_light_block) == 64, "std140 layout of DirectionalLight");
+static_assert(sizeof(point_light_block) == 64, "std140 layout of PointLight");
+static_assert(offsetof(spot_light_block, cut_off) == 32, "std140 layout of SpotLight");
+static_assert(offsetof(spot_light_block, diffuse) == 48, "std140 layout of SpotLight");
+static_assert(sizeof(spot_light_block) == 80, "std140 layout of SpotLight");
+static_assert(offsetof(lights_block, point_lights) == 64, "std140 layout of Lights");
+static_assert(offsetof(lights_block, spot) == 320, "std140 layout of Lights");
+
+frame_uniforms::frame_uniforms()
+    :
+    frame_buffer_(create_buffer(uniform_block::frame, sizeof(frame_block))),
+    camera_buffer_(create_buffer(uniform_block::camera, sizeof(camera_block))),
+    lights_buffer_(create_buffer(uniform_block::lights, sizeof(lights_block)))
+{
+}
+
+frame_uniforms::~frame_uniforms()
+{
+    const GLuint buffers[] = {frame_buffer_, camera_buffer_, lights_buffer_};
+    glDeleteBuffers(3, buffers);
+}
+
+void frame_uniforms::update(const frame_block& frame) const
+{
+    write_buffer(frame_buffer_, &frame, sizeof(frame));
+}
+
+void frame_uniforms::update(const camera_block& camera) const
+{
+    write_buffer(camera_buffer_, &camera, sizeof(camera));
+}
+
+void frame_uniforms::update(const lights_block& lights) const
+{
+    write_buffer(lights_buffer_, &lights, sizeof(lights));
+}
+
+GLuint frame_uniforms::create_buffer(const uniform_block block, const size_t size)
+{
+    GLuint buffer;
+    glGenBuffers(1, &buffer);
+    glBindBuffer(GL_UNIFORM_BUFFER, buffer);
+    glBufferData(GL_UNIFORM_BUFFER, static_cast<GLsizeiptr>(size), nullptr, GL_DYNAMIC_DRAW);
+    glBindBufferBase(GL_UNIFORM_BUFFER, static_cast<GLuint>(block), buffer);
+    glBindBuffer(GL_UNIFORM_BUFFER, 0);
+    return buffer;
+}
+
+void frame_uniforms::write_buffer(const GLuint buffer, const void* data, const size_t size)
+{
+    glBindBuffer(GL_UNIFORM_BUFFER, buffer);
+    glBufferSubData(GL_UNIFORM_BUFFER, 0, static_cast<GLsizeiptr>(size), data);
+    glBindBuffer(GL_UNIFORM_BUFFER, 0);
+}
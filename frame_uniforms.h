@@ -0,0 +1,85 @@
+﻿#pragma once
+#include <cstddef>
+#include <glm/glm.hpp>
+
+#include "shader.h"
+
+// Contents of the shared uniform blocks, laid out like their std140 declarations in the shaders: every vec3 starts
+// on 16 bytes, structs and array elements are padded to 16 bytes. The static_asserts in frame_uniforms.cpp check the
+// offsets the shaders rely on.
+
+// layout (std140) uniform Frame
+struct frame_block
+{
+    float time = 0.0f;
+    float delta_time = 0.0f;
+    glm::vec2 viewport_size{0.0f};
+};
+
+// layout (std140) uniform Camera
+struct camera_block
+{
+    glm::mat4 view{1.0f};
+    glm::mat4 projection{1.0f};
+    alignas(16) glm::vec3 position{0.0f};
+};
+
+struct directional_light_block
+{
+    alignas(16) glm::vec3 direction{0.0f};
+    alignas(16) glm::vec3 ambient{0.0f};
+    alignas(16) glm::vec3 diffuse{0.0f};
+    alignas(16) glm::vec3 specular{0.0f};
+};
+
+struct point_light_block
+{
+    alignas(16) glm::vec3 position{0.0f};
+    alignas(16) glm::vec3 attenuation_coefficients{0.0f};
+    alignas(16) glm::vec3 diffuse{0.0f};
+    alignas(16) glm::vec3 specular{0.0f};
+};
+
+struct spot_light_block
+{
+    alignas(16) glm::vec3 position{0.0f};
+    alignas(16) glm::vec3 direction{0.0f};
+    // cosines of the inner and outer cone angle
+    alignas(16) glm::vec2 cut_off{0.0f};
+    alignas(16) glm::vec3 diffuse{0.0f};
+    alignas(16) glm::vec3 specular{0.0f};
+};
+
+// layout (std140) uniform Lights
+struct lights_block
+{
+    // NR_POINT_LIGHTS in shader.frag
+    static constexpr size_t point_light_count = 4;
+
+    directional_light_block directional;
+    point_light_block point_lights[point_light_count];
+    spot_light_block spot;
+};
+
+// Owns one uniform buffer per block, bound to its uniform_block binding point for as long as it lives. Each block is
+// written with a single glBufferSubData per frame, instead of setting its members program by program.
+class frame_uniforms
+{
+public:
+    frame_uniforms();
+    ~frame_uniforms();
+    frame_uniforms(const frame_uniforms&) = delete;
+    frame_uniforms& operator=(const frame_uniforms&) = delete;
+
+    void update(const frame_block& frame) const;
+    void update(const camera_block& camera) const;
+    void update(const lights_block& lights) const;
+
+private:
+    GLuint frame_buffer_ = 0;
+    GLuint camera_buffer_ = 0;
+    GLuint lights_buffer_ = 0;
+
+    static GLuint create_buffer(uniform_block block, size_t size);
+    static void write_buffer(GLuint buffer, const void* data, size_t size);
+};
@@ -0,0 +1,53 @@
+﻿#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <type_traits>
+
+// 64-bit FNV-1a, used to key on-disk caches. Not cryptographic, only meant to detect changed inputs.
+constexpr std::uint64_t fnv1a_offset_basis = 14695981039346656037ull;
+constexpr std::uint64_t fnv1a_prime = 1099511628211ull;
+
+inline std::uint64_t hash_bytes(const void* data, const size_t size, std::uint64_t hash = fnv1a_offset_basis)
+{
+    const auto bytes = static_cast<const unsigned char*>(data);
+    for (size_t i = 0; i < size; ++i)
+    {
+        hash ^= bytes[i];
+        hash *= fnv1a_prime;
+    }
+    return hash;
+}
+
+// hash_bytes() for characters, usable in constant expressions, e.g. to hash string literals at compile time
+constexpr std::uint64_t hash_chars(const char* chars, const size_t length, std::uint64_t hash = fnv1a_offset_basis)
+{
+    for (size_t i = 0; i < length; ++i)
+    {
+        hash ^= static_cast<unsigned char>(chars[i]);
+        hash *= fnv1a_prime;
+    }
+    return hash;
+}
+
+template <typename T>
+std::uint64_t hash_value(const T& value, const std::uint64_t hash = fnv1a_offset_basis)
+{
+    static_assert(std::is_trivially_copyable<T>::value, "only plain values can be hashed byte-wise");
+    return hash_bytes(&value, sizeof(T), hash);
+}
+
+inline std::uint64_t hash_string(const std::string& value, const std::uint64_t hash = fnv1a_offset_basis)
+{
+    return hash_bytes(value.data(), value.size(), hash_value(value.size(), hash));
+}
+
+inline std::string hash_to_hex(const std::uint64_t hash)
+{
+    constexpr char digits[] = "0123456789abcdef";
+    std::string result(16, '0');
+    for (int i = 15; i >= 0; --i)
+        result[15 - i] = digits[(hash >> (i * 4)) & 0xF];
+    return result;
+}
@@ -0,0 +1,42 @@
+﻿#include "image.h"
+
+#include <iostream>
+
+#include "asset_io.h"
+#include "hash.h"
+#include "profiler.h"
+#include "stb_image.h"
+
+bool image::is_valid() const
+{
+    return pixels != nullptr;
+}
+
+image decode_image(const std::string& filename, const bool flip_vertically)
+{
+    profile_scope scope("decode", filename);
+
+    // thread-local override of stbi_set_flip_vertically_on_load, so concurrent decodes don't race on the setting
+    stbi_set_flip_vertically_on_load_thread(flip_vertically);
+
+    image result;
+    const auto file = asset_io::instance().open(filename);
+    if (!file->is_open())
+    {
+        std::cout << "Texture failed to load at path: " << filename << " (can't open file)" << std::endl;
+        return result;
+    }
+
+    unsigned char* data = stbi_load_from_memory(file->data(), static_cast<int>(file->size()), &result.width,
+                                                &result.height, &result.channels, 0);
+    if (!data)
+    {
+        std::cout << "Texture failed to load at path: " << filename << " (" << stbi_failure_reason() << ")" <<
+            std::endl;
+        return result;
+    }
+
+    result.pixels = {data, stbi_image_free};
+    result.content_hash = hash_bytes(file->data(), file->size(), hash_value(flip_vertically));
+    return result;
+}
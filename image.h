@@ -0,0 +1,31 @@
+﻿#pragma once
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+struct mip_level
+{
+    int width;
+    int height;
+    // tightly packed rows, same channel count as the image
+    std::vector<unsigned char> pixels;
+};
+
+// Decoded 8-bit image in memory, as returned by stb_image.
+struct image
+{
+    int width = 0;
+    int height = 0;
+    int channels = 0;
+    std::unique_ptr<unsigned char, void(*)(void*)> pixels{nullptr, nullptr};
+    // hash of the encoded source bytes and the decode options, identical for identical files under any name
+    std::uint64_t content_hash = 0;
+    // levels below the full image, see generate_mipmaps(); empty until generated
+    std::vector<mip_level> mip_levels;
+
+    bool is_valid() const;
+};
+
+// Safe to call from any thread: the vertical flip is applied per call instead of through stb_image's global flag.
+image decode_image(const std::string& filename, bool flip_vertically);
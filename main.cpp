@@ -1,6 +1,9 @@
 // ReSharper disable CppClangTidyPerformanceNoIntToPtr
 #include <glad/glad.h>
 #include <GLFW/glfw3.h>
+#include <cctype>
+#include <chrono>
+#include <cstdlib>
 #include <iostream>
 #include <map>
 
@@ -11,10 +14,18 @@
 #include "camera.h"
 #include <vector>
 
+#include "asset_io.h"
 #include "cubemap.h"
+#include "frame_uniforms.h"
+#include "image.h"
+#include "mipmap.h"
 #include "model.h"
+#include "profiler.h"
+#include "program_cache.h"
+#include "shader_compiler.h"
 #include "skybox.h"
 #include "stb_image.h"
+#include "thread_pool.h"
 
 int window_width = 800;
 int window_height = 600;
@@ -89,8 +100,82 @@ void scroll_callback(GLFWwindow* window, double offset_x, const double offset_y)
     scene_camera.process_mouse_scroll(static_cast<float>(offset_y));
 }
 
-int main()
+// Times glGenerateMipmap against the CPU chain uploaded level by level, both including the base level upload.
+// glFinish() keeps the driver's deferred work inside each measurement.
+void benchmark_mipmaps()
 {
+    const char* paths[] = {
+        "./assets/backpack/diffuse.jpg",
+        "./assets/backpack/specular.jpg",
+        "./assets/backpack/normal.png",
+        "./assets/backpack/roughness.jpg",
+        "./assets/backpack/ao.jpg",
+        "./assets/skybox/right.jpg",
+        "./assets/skybox/left.jpg",
+        "./assets/skybox/top.jpg",
+        "./assets/skybox/bottom.jpg",
+        "./assets/skybox/front.jpg",
+        "./assets/skybox/back.jpg",
+    };
+
+    using milliseconds = std::chrono::duration<double, std::milli>;
+    milliseconds total_gpu{0};
+    milliseconds total_cpu{0};
+    for (const auto* path : paths)
+    {
+        const auto image = decode_image(path, false);
+        if (!image.is_valid())
+            continue;
+
+        const GLenum format = image.channels == 1 ? GL_RED : image.channels == 3 ? GL_RGB : GL_RGBA;
+        unsigned int textures[2];
+        glGenTextures(2, textures);
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+        glFinish();
+
+        auto start_time = std::chrono::steady_clock::now();
+        glBindTexture(GL_TEXTURE_2D, textures[0]);
+        glTexImage2D(GL_TEXTURE_2D, 0, format, image.width, image.height, 0, format, GL_UNSIGNED_BYTE,
+                     image.pixels.get());
+        glGenerateMipmap(GL_TEXTURE_2D);
+        glFinish();
+        const milliseconds gpu_time = std::chrono::steady_clock::now() - start_time;
+
+        start_time = std::chrono::steady_clock::now();
+        const auto mip_levels = generate_mip_chain(image.pixels.get(), image.width, image.height, image.channels,
+                                                   true);
+        const milliseconds generate_time = std::chrono::steady_clock::now() - start_time;
+        glBindTexture(GL_TEXTURE_2D, textures[1]);
+        glTexImage2D(GL_TEXTURE_2D, 0, format, image.width, image.height, 0, format, GL_UNSIGNED_BYTE,
+                     image.pixels.get());
+        for (size_t level = 0; level < mip_levels.size(); ++level)
+        {
+            const auto& data = mip_levels[level];
+            glTexImage2D(GL_TEXTURE_2D, static_cast<GLint>(level + 1), format, data.width, data.height, 0, format,
+                         GL_UNSIGNED_BYTE, data.pixels.data());
+        }
+        glFinish();
+        const milliseconds cpu_time = std::chrono::steady_clock::now() - start_time;
+
+        std::cout << "MIPMAP_BENCHMARK::" << path << " " << image.width << "x" << image.height << "x" << image.channels
+            << " glGenerateMipmap " << gpu_time.count() << " ms, cpu chain " << cpu_time.count() << " ms ("
+            << generate_time.count() << " ms generating)" << std::endl;
+        total_gpu += gpu_time;
+        total_cpu += cpu_time;
+
+        glDeleteTextures(2, textures);
+    }
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+
+    std::cout << "MIPMAP_BENCHMARK::TOTAL glGenerateMipmap " << total_gpu.count() << " ms, cpu chain "
+        << total_cpu.count() << " ms" << std::endl;
+}
+
+int main(const int argc, char* argv[])
+{
+    // startup times are measured from here
+    profiler::instance();
+
     glfwInit();
     glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
     glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
@@ -117,18 +202,71 @@ int main()
         std::cout << "Failed to initialize GLAD" << std::endl;
         return -1;
     }
+    program_cache::load_functions(reinterpret_cast<GLADloadproc>(glfwGetProcAddress));
+    shader_compiler::initialize(reinterpret_cast<GLADloadproc>(glfwGetProcAddress));
+    // options for comparing startup times, any combination in any order
+    bool run_mipmap_benchmark = false;
+    for (int i = 1; i < argc; ++i)
+    {
+        const std::string argument = argv[i];
+        if (argument == "--serial-shaders")
+        {
+            // programs are otherwise built in a batch
+            shader_compiler::set_mode(shader_compile_mode::serial);
+        }
+        else if (argument == "--benchmark-mipmaps")
+        {
+            run_mipmap_benchmark = true;
+        }
+        else if (argument == "--decode-threads" && i + 1 < argc)
+        {
+            // the shared pool otherwise gets one worker per hardware thread; it is created on first use, which
+            // comes later
+            const char* count = argv[++i];
+            char* count_end = nullptr;
+            const auto thread_count = std::isdigit(static_cast<unsigned char>(count[0])) ?
+                                          std::strtoul(count, &count_end, 10) : 0;
+            if (thread_count == 0 || *count_end != '\0')
+                std::cout << "ERROR::MAIN::INVALID_THREAD_COUNT " << count << std::endl;
+            else
+                thread_pool::set_shared_thread_count(thread_count);
+        }
+        else
+        {
+            std::cout << "ERROR::MAIN::UNKNOWN_ARGUMENT " << argument << std::endl;
+        }
+    }
+
+    profiler::instance().mark("window created");
+
+    if (run_mipmap_benchmark)
+    {
+        benchmark_mipmaps();
+        glfwTerminate();
+        return 0;
+    }
 
     glEnable(GL_CULL_FACE);
 
     glViewport(0, 0, window_width, window_height);
 
-    const shader lit_shader("./shaders/shader.vert", "./shaders/shader.frag");
-    const shader light_shader("./shaders/shader.vert", "./shaders/light_shader.frag");
-    const shader grass_shader("./shaders/shader.vert", "./shaders/alpha_clip.frag");
-    const shader transparent_shader("./shaders/shader.vert", "./shaders/unlit_alpha.frag");
+    // the backpack is the heaviest asset, stream it in while the rest of the scene is already rendering
+    model_params backpack_model_params;
+    backpack_model_params.batch_meshes = true;
+    backpack_model_params.weld_vertices = true;
+    backpack_model_params.optimize_meshes = true;
+    backpack_model_params.compact_vertices = true;
+    backpack_model_params.lod_count = 4;
+    backpack_model_params.build_meshlets = true;
+    backpack_model_params.compress_textures = true;
 
-    model backpack("./assets/backpack/backpack.obj");
-    model cube("./assets/cube.obj");
+    model_params grass_model_params;
+    grass_model_params.texture_clamp = true;
+    grass_model_params.texture_flip = false;
+    grass_model_params.pack_textures = true;
+
+    model_params glass_box_model_params;
+    glass_box_model_params.pack_textures = true;
 
     std::string skybox_sides[] = {
         "./assets/skybox/right.jpg",
@@ -138,16 +276,62 @@ int main()
         "./assets/skybox/front.jpg",
         "./assets/skybox/back.jpg",
     };
-    cubemap skybox_cubemap(skybox_sides);
+
+    // read the whole startup set in parallel up front, the loads below then find it mapped and in memory
+    std::vector<std::string> startup_files{
+        "./shaders/shader.vert", "./shaders/shader.frag", "./shaders/light_shader.frag", "./shaders/alpha_clip.frag",
+        "./shaders/unlit_alpha.frag", "./shaders/skybox.vert", "./shaders/skybox.frag", "./shaders/blit.vert",
+        "./shaders/postfx.frag", "./shaders/geometry_grass.vert", "./shaders/geometry_grass.frag",
+        "./shaders/geometry_grass.geom",
+    };
+    const auto add_startup_files = [&startup_files](const std::vector<std::string>& files)
+    {
+        startup_files.insert(startup_files.end(), files.begin(), files.end());
+    };
+    add_startup_files(model::get_input_files("./assets/backpack/backpack.obj", backpack_model_params));
+    add_startup_files(model::get_input_files("./assets/cube.obj"));
+    add_startup_files(model::get_input_files("./assets/grass/grass.obj", grass_model_params));
+    add_startup_files(model::get_input_files("./assets/glass_box/glass_box.obj", glass_box_model_params));
+    add_startup_files(cubemap::get_input_files(skybox_sides));
+    asset_io::instance().prefetch(startup_files);
+
+    shader lit_shader("./shaders/shader.vert", "./shaders/shader.frag", nullptr,
+                      {"POINT_LIGHTS", "SPOT_LIGHT", "REFLECTION"});
+    const shader_keywords lit_point_lights = lit_shader.get_keyword("POINT_LIGHTS");
+    const shader_keywords lit_spot_light = lit_shader.get_keyword("SPOT_LIGHT");
+    const shader_keywords lit_reflection = lit_shader.get_keyword("REFLECTION");
+    const shader light_shader("./shaders/shader.vert", "./shaders/light_shader.frag");
+    // grass and glass_box are loaded with pack_textures, the keyword samples their textures from texture arrays
+    const shader grass_shader("./shaders/shader.vert", "./shaders/alpha_clip.frag", nullptr, {"TEXTURE_ARRAYS"});
+    const shader transparent_shader("./shaders/shader.vert", "./shaders/unlit_alpha.frag", nullptr,
+                                    {"TEXTURE_ARRAYS"});
+    const shader_keywords grass_texture_arrays = grass_shader.get_keyword("TEXTURE_ARRAYS");
+    const shader_keywords transparent_texture_arrays = transparent_shader.get_keyword("TEXTURE_ARRAYS");
+    // set for every instance, hashed at compile time
+    constexpr uniform_id model_uniform("model");
     const shader skybox_shader("./shaders/skybox.vert", "./shaders/skybox.frag");
+    shader post_fx_shader("./shaders/blit.vert", "./shaders/postfx.frag");
+    shader geometry_grass_shader("./shaders/geometry_grass.vert", "./shaders/geometry_grass.frag",
+                                 "./shaders/geometry_grass.geom");
+    // in batch mode the driver compiles these programs while the models load, they are waited for on first use; the
+    // lit variant is the one the backpack starts with
+    lit_shader.submit(lit_point_lights | lit_spot_light | lit_reflection);
+    light_shader.submit();
+    grass_shader.submit(grass_texture_arrays);
+    transparent_shader.submit(transparent_texture_arrays);
+    skybox_shader.submit();
+    post_fx_shader.submit();
+    geometry_grass_shader.submit();
+
+    model backpack = model::load_async("./assets/backpack/backpack.obj", backpack_model_params);
+    model cube("./assets/cube.obj");
+
+    cubemap skybox_cubemap(skybox_sides, false, true);
     skybox scene_skybox(skybox_cubemap, skybox_shader);
 
-    model_params grass_model_params;
-    grass_model_params.texture_clamp = true;
-    grass_model_params.texture_flip = false;
     model grass("./assets/grass/grass.obj", grass_model_params);
 
-    model glass_box("./assets/glass_box/glass_box.obj");
+    model glass_box("./assets/glass_box/glass_box.obj", glass_box_model_params);
 
     const std::vector<glm::vec3> model_positions{
         glm::vec3(0.0f, 0.0f, 0.0f),
@@ -161,6 +345,8 @@ int main()
         glm::vec3(1.5f, 0.2f, -1.5f),
         glm::vec3(-1.3f, 1.0f, -1.5f)
     };
+    // level of detail each backpack was drawn with last frame
+    std::vector<size_t> model_lods(model_positions.size(), 0);
 
     const std::vector<glm::vec3> start_light_positions = {
         glm::vec3(0.7f, 0.2f, 2.0f),
@@ -169,6 +355,24 @@ int main()
         glm::vec3(0.0f, 0.0f, -3.0f)
     };
 
+    // camera and lights for every shader, written once per frame
+    const frame_uniforms scene_uniforms;
+    frame_block frame;
+    camera_block camera;
+    lights_block lights;
+
+    lights.directional.direction = glm::vec3(-0.2f, -1.0f, -0.3f);
+    lights.directional.ambient = glm::vec3(0.2f, 0.2f, 0.2f);
+    lights.directional.diffuse = glm::vec3(0.5f, 0.5f, 0.5f);
+    lights.directional.specular = glm::vec3(1.0f, 1.0f, 1.0f);
+    for (auto& point_light : lights.point_lights)
+    {
+        point_light.diffuse = glm::vec3(0.5f, 0.5f, 0.5f);
+        point_light.specular = glm::vec3(1.0f, 1.0f, 1.0f);
+        point_light.attenuation_coefficients = glm::vec3(1.0f, 0.09f, 0.032f);
+    }
+    lights.spot.cut_off = glm::vec2(glm::cos(glm::radians(10.0f)), glm::cos(glm::radians(12.5f)));
+
     const std::vector<glm::vec3> vegetation = {
         (glm::vec3(-1.5f, 0.0f, -0.48f)),
         (glm::vec3(1.5f, 0.0f, 0.51f)),
@@ -187,36 +391,37 @@ int main()
     };
 
     // create frame buffer
-    unsigned int framebuffer;
-    glGenFramebuffers(1, &framebuffer);
-    glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
-
-    // create color attachment for the frame buffer
-    unsigned int texture_color_buffer;
-    glGenTextures(1, &texture_color_buffer);
-    glBindTexture(GL_TEXTURE_2D, texture_color_buffer);
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, window_width, window_height, 0, GL_RGB, GL_UNSIGNED_BYTE, nullptr);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-    glBindTexture(GL_TEXTURE_2D, 0);
-
-    // attach color to the frame buffer
-    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, texture_color_buffer, 0);
-
-    // create depth/stencil attachment for the frame buffer
-    unsigned int depth_stencil_rbo;
-    glGenRenderbuffers(1, &depth_stencil_rbo);
-    glBindRenderbuffer(GL_RENDERBUFFER, depth_stencil_rbo);
-    glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH24_STENCIL8, window_width, window_height);
-    glBindRenderbuffer(GL_RENDERBUFFER, 0);
-
-    // attach depth/stencil to the frame buffer
-    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, GL_RENDERBUFFER, depth_stencil_rbo);
-
-    // validate the frame buffer
-    if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
-        std::cout << "ERROR::FRAMEBUFFER:: Framebuffer is not complete!" << std::endl;
-    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    unsigned int framebuffer, texture_color_buffer, depth_stencil_rbo;
+    {
+        profile_scope scope("init", "framebuffer");
+        glGenFramebuffers(1, &framebuffer);
+        glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+
+        // create color attachment for the frame buffer
+        glGenTextures(1, &texture_color_buffer);
+        glBindTexture(GL_TEXTURE_2D, texture_color_buffer);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, window_width, window_height, 0, GL_RGB, GL_UNSIGNED_BYTE, nullptr);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        glBindTexture(GL_TEXTURE_2D, 0);
+
+        // attach color to the frame buffer
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, texture_color_buffer, 0);
+
+        // create depth/stencil attachment for the frame buffer
+        glGenRenderbuffers(1, &depth_stencil_rbo);
+        glBindRenderbuffer(GL_RENDERBUFFER, depth_stencil_rbo);
+        glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH24_STENCIL8, window_width, window_height);
+        glBindRenderbuffer(GL_RENDERBUFFER, 0);
+
+        // attach depth/stencil to the frame buffer
+        glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, GL_RENDERBUFFER, depth_stencil_rbo);
+
+        // validate the frame buffer
+        if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+            std::cout << "ERROR::FRAMEBUFFER:: Framebuffer is not complete!" << std::endl;
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    }
 
     float blit_quad_vertices[] = {
         // positions   // texCoords
@@ -255,8 +460,6 @@ int main()
 
     glBindVertexArray(0);
 
-    shader post_fx_shader("./shaders/blit.vert", "./shaders/postfx.frag");
-
     glm::vec3 up(0, 1, 0);
     glm::vec2 zero2(0, 0);
     mesh geometry_grass_points(
@@ -269,18 +472,64 @@ int main()
         {0, 1, 2, 3},
         std::vector<texture>()
     );
-    shader geometry_grass_shader("./shaders/geometry_grass.vert", "./shaders/geometry_grass.frag",
-                                 "./shaders/geometry_grass.geom");
 
+    double statistics_start_time = glfwGetTime();
+    size_t statistics_frames = 0, statistics_triangles = 0, statistics_draw_calls = 0, statistics_meshlets_culled = 0;
+    size_t statistics_uniform_calls = 0, statistics_uniform_calls_skipped = 0;
+
+    bool first_frame_presented = false;
+    bool startup_io_reported = false;
     while (!glfwWindowShouldClose(window))
     {
         const double current_frame_time = glfwGetTime();
         delta_time = static_cast<float>(current_frame_time - last_frame_time);
         last_frame_time = current_frame_time;
 
+        // statistics, averaged over a second and shown in the title bar
+        statistics_frames++;
+        statistics_triangles += frame_draw_statistics.triangles;
+        statistics_draw_calls += frame_draw_statistics.draw_calls;
+        statistics_meshlets_culled += frame_draw_statistics.meshlets_culled;
+        statistics_uniform_calls += frame_uniform_statistics.calls_made;
+        statistics_uniform_calls_skipped += frame_uniform_statistics.calls_skipped;
+        frame_draw_statistics.reset();
+        frame_uniform_statistics.reset();
+        if (current_frame_time - statistics_start_time >= 1.0)
+        {
+            const auto title = "LearnOpenGL - " +
+                std::to_string(static_cast<int>(statistics_frames / (current_frame_time - statistics_start_time))) +
+                " fps, " + std::to_string(statistics_triangles / statistics_frames) + " triangles, " +
+                std::to_string(statistics_draw_calls / statistics_frames) + " draw calls, " +
+                std::to_string(statistics_meshlets_culled / statistics_frames) + " meshlets culled, " +
+                std::to_string(statistics_uniform_calls / statistics_frames) + " uniform calls (" +
+                std::to_string(statistics_uniform_calls_skipped / statistics_frames) + " skipped)";
+            glfwSetWindowTitle(window, title.c_str());
+            statistics_start_time = current_frame_time;
+            statistics_frames = statistics_triangles = statistics_draw_calls = statistics_meshlets_culled = 0;
+            statistics_uniform_calls = statistics_uniform_calls_skipped = 0;
+        }
+
         // input
         process_input(window);
 
+        // streaming
+        backpack.update_loading();
+        if (!startup_io_reported && backpack.is_ready())
+        {
+            asset_io::instance().report("STARTUP");
+            const size_t resident_bytes = backpack.get_resident_cpu_bytes() + cube.get_resident_cpu_bytes() +
+                grass.get_resident_cpu_bytes() + glass_box.get_resident_cpu_bytes();
+            std::cout << "MODEL::RESIDENT_CPU_GEOMETRY " << resident_bytes / 1024 << " KiB" << std::endl;
+
+            auto& startup_profiler = profiler::instance();
+            startup_profiler.mark("all assets loaded");
+            startup_profiler.stop();
+            startup_profiler.write_trace("startup_trace.json");
+            startup_profiler.print_summary("STARTUP");
+            asset_io::instance().release_prefetched();
+            startup_io_reported = true;
+        }
+
         // simulate
         std::vector<glm::vec3> light_positions;
 
@@ -307,45 +556,45 @@ int main()
                                                  static_cast<float>(window_width) / static_cast<float>(window_height),
                                                  0.1f, 100.0f);
 
+        frame.time = static_cast<float>(current_frame_time);
+        frame.delta_time = delta_time;
+        frame.viewport_size = glm::vec2(static_cast<float>(window_width), static_cast<float>(window_height));
+        scene_uniforms.update(frame);
+
+        camera.view = view;
+        camera.projection = projection;
+        camera.position = scene_camera.position;
+        scene_uniforms.update(camera);
+
+        for (size_t i = 0; i < light_positions.size(); i++)
+            lights.point_lights[i].position = light_positions[i];
+        const float flashlight_intensity = use_flashlight ? 1.0f : 0.0f;
+        lights.spot.position = scene_camera.position;
+        lights.spot.direction = scene_camera.direction_front;
+        lights.spot.diffuse = glm::vec3(0.5f, 0.5f, 0.5f) * flashlight_intensity;
+        lights.spot.specular = glm::vec3(1.0f, 1.0f, 1.0f) * flashlight_intensity;
+        scene_uniforms.update(lights);
+
         // opaque pass
         glBlendFunc(GL_ONE, GL_ZERO);
 
-        lit_shader.use();
-
-        lit_shader.set_vec3("viewPos", scene_camera.position);
+        // only the lighting the draw needs is compiled into the variant it uses
+        const float backpack_reflectivity = 0.5f;
+        shader_keywords backpack_keywords = lit_point_lights;
+        if (use_flashlight)
+            backpack_keywords |= lit_spot_light;
+        if (backpack_reflectivity > 0.0f)
+            backpack_keywords |= lit_reflection;
+        lit_shader.use(backpack_keywords);
 
         lit_shader.set_vec3("material.diffuse", 1.0f, 1.0f, 1.0f);
         lit_shader.set_vec3("material.specular", 1.0f, 1.0f, 1.0f);
         lit_shader.set_float("material.shininess", 32.0f);
-        lit_shader.set_float("material.reflectivity", 0.5f);
-
-        lit_shader.set_vec3("light.direction", -0.2f, -1.0f, -0.3f);
-        lit_shader.set_vec3("light.ambient", 0.2f, 0.2f, 0.2f);
-        lit_shader.set_vec3("light.diffuse", 0.5f, 0.5f, 0.5f);
-        lit_shader.set_vec3("light.specular", 1.0f, 1.0f, 1.0f);
-
-
-        for (size_t i = 0; i < light_positions.size(); i++)
-        {
-            auto prefix = "pointLights[" + std::to_string(i) + "].";
-            lit_shader.set_vec3(prefix + "position", light_positions[i]);
-            lit_shader.set_vec3(prefix + "diffuse", 0.5f, 0.5f, 0.5f);
-            lit_shader.set_vec3(prefix + "specular", 1.0f, 1.0f, 1.0f);
-            lit_shader.set_vec3(prefix + "attenuationCoefficients", 1.0f, 0.09f, 0.032f);
-        }
-
-        const float flashlight_intensity = use_flashlight ? 1.0f : 0.0f;
-        lit_shader.set_vec3("spotLight.position", scene_camera.position);
-        lit_shader.set_vec3("spotLight.direction", scene_camera.direction_front);
-        lit_shader.set_vec2("spotLight.cutOff", glm::cos(glm::radians(10.0f)), glm::cos(glm::radians(12.5f)));
-        lit_shader.set_vec3("spotLight.diffuse", glm::vec3(0.5f, 0.5f, 0.5f) * flashlight_intensity);
-        lit_shader.set_vec3("spotLight.specular", glm::vec3(1.0f, 1.0f, 1.0f) * flashlight_intensity);
+        lit_shader.set_float("material.reflectivity", backpack_reflectivity);
 
         std::vector<extra_texture> extra_textures;
         extra_textures.push_back(extra_texture{skybox_cubemap.get_id(), "skybox", GL_TEXTURE_CUBE_MAP});
 
-        lit_shader.set_mat4("view", view);
-        lit_shader.set_mat4("projection", projection);
         glm::mat4 model;
 
 
@@ -357,41 +606,36 @@ int main()
             const float angle = static_cast<float>(i) * 20.0f;
             model = rotate(model, glm::radians(angle), glm::vec3(1.0f, 0.3f, 0.5f));
             model = scale(model, glm::vec3(0.5f, 0.5f, 0.5f));
-            lit_shader.set_mat4("model", model);
+            lit_shader.set_mat4(model_uniform, model);
 
-            backpack.draw(lit_shader, extra_textures);
+            backpack.draw(lit_shader, extra_textures, model, view, projection, model_lods[i]);
         }
 
         light_shader.use();
-        light_shader.set_mat4("projection", projection);
-        light_shader.set_mat4("view", view);
 
         for (auto light_position : light_positions)
         {
             model = glm::mat4(1.0f);
             model = translate(model, light_position);
             model = scale(model, glm::vec3(0.2f));
-            light_shader.set_mat4("model", model);
+            light_shader.set_mat4(model_uniform, model);
             cube.draw(light_shader);
         }
 
-        grass_shader.use();
-        grass_shader.set_mat4("projection", projection);
-        grass_shader.set_mat4("view", view);
+        // textures too large or block compressed to pack are plain textures, sampled by the variant without arrays
+        grass_shader.use(grass.has_texture_arrays() ? grass_texture_arrays : 0);
         grass_shader.set_float("material.alphaClipThreshold", 0.01f);
 
         for (auto grass_position : vegetation)
         {
             model = glm::mat4(1.0f);
             model = translate(model, grass_position);
-            grass_shader.set_mat4("model", model);
+            grass_shader.set_mat4(model_uniform, model);
             grass.draw(grass_shader);
         }
 
         geometry_grass_shader.use();
-        geometry_grass_shader.set_mat4("projection", projection);
-        geometry_grass_shader.set_mat4("view", view);
-        geometry_grass_shader.set_mat4("model", glm::mat4(1.0f));
+        geometry_grass_shader.set_mat4(model_uniform, glm::mat4(1.0f));
         geometry_grass_shader.set_float("width", 0.5f);
         geometry_grass_shader.set_float("height", 1.0f);
         geometry_grass_shader.set_float("bendDegree", 30.0f);
@@ -399,14 +643,12 @@ int main()
         geometry_grass_points.draw(geometry_grass_shader, std::vector<extra_texture>(), GL_POINTS);
 
         // skybox
-        scene_skybox.draw(view, projection);
+        scene_skybox.draw();
 
         // transparent pass
         glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
 
-        transparent_shader.use();
-        transparent_shader.set_mat4("projection", projection);
-        transparent_shader.set_mat4("view", view);
+        transparent_shader.use(glass_box.has_texture_arrays() ? transparent_texture_arrays : 0);
 
         // sort geometry
         std::map<float, glm::vec3> sorted_glass_boxes;
@@ -421,7 +663,7 @@ int main()
             model = glm::mat4(1.0f);
             model = translate(model, it->second);
             model = scale(model, glm::vec3(0.2f));
-            transparent_shader.set_mat4("model", model);
+            transparent_shader.set_mat4(model_uniform, model);
             glass_box.draw(transparent_shader);
         }
 
@@ -441,8 +683,17 @@ int main()
         // check and call events and swap buffers
         glfwSwapBuffers(window);
         glfwPollEvents();
+
+        if (!first_frame_presented)
+        {
+            profiler::instance().mark("first frame");
+            // every startup program was used by now
+            shader_compiler::report();
+            first_frame_presented = true;
+        }
     }
 
+    shader_compiler::release_stages();
     glfwTerminate();
     return 0;
 }
@@ -0,0 +1,173 @@
+﻿#include "mapped_file.h"
+
+#include <atomic>
+#include <utility>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <Windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace
+{
+    std::atomic<size_t> system_call_count{0};
+
+    // the smallest page size of the supported platforms, touching more often than needed is harmless
+    constexpr size_t page_size = 4096;
+}
+
+mapped_file::mapped_file(const std::string& path)
+{
+#ifdef _WIN32
+    ++system_call_count;
+    const HANDLE file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING,
+                                    FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+    if (file == INVALID_HANDLE_VALUE)
+        return;
+    file_handle_ = file;
+
+    LARGE_INTEGER file_size;
+    ++system_call_count;
+    if (!GetFileSizeEx(file, &file_size) || file_size.QuadPart == 0)
+    {
+        close();
+        return;
+    }
+
+    ++system_call_count;
+    const HANDLE mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    if (mapping == nullptr)
+    {
+        close();
+        return;
+    }
+    mapping_handle_ = mapping;
+
+    ++system_call_count;
+    const void* view = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+    if (view == nullptr)
+    {
+        close();
+        return;
+    }
+
+    data_ = static_cast<const unsigned char*>(view);
+    size_ = static_cast<size_t>(file_size.QuadPart);
+#else
+    ++system_call_count;
+    const int file = open(path.c_str(), O_RDONLY);
+    if (file < 0)
+        return;
+
+    // fstat, then either close or mmap and close
+    struct stat file_stat{};
+    if (fstat(file, &file_stat) != 0 || file_stat.st_size == 0)
+    {
+        system_call_count += 2;
+        ::close(file);
+        return;
+    }
+
+    const auto file_size = static_cast<size_t>(file_stat.st_size);
+    system_call_count += 3;
+    void* view = mmap(nullptr, file_size, PROT_READ, MAP_PRIVATE, file, 0);
+    ::close(file);
+    if (view == MAP_FAILED)
+        return;
+
+    data_ = static_cast<const unsigned char*>(view);
+    size_ = file_size;
+#endif
+}
+
+mapped_file::~mapped_file()
+{
+    close();
+}
+
+mapped_file::mapped_file(mapped_file&& other) noexcept
+{
+    *this = std::move(other);
+}
+
+mapped_file& mapped_file::operator=(mapped_file&& other) noexcept
+{
+    if (this != &other)
+    {
+        close();
+        std::swap(data_, other.data_);
+        std::swap(size_, other.size_);
+#ifdef _WIN32
+        std::swap(file_handle_, other.file_handle_);
+        std::swap(mapping_handle_, other.mapping_handle_);
+#endif
+    }
+    return *this;
+}
+
+void mapped_file::prefetch() const
+{
+    if (!data_)
+        return;
+
+#ifdef _WIN32
+    WIN32_MEMORY_RANGE_ENTRY range{const_cast<unsigned char*>(data_), size_};
+    PrefetchVirtualMemory(GetCurrentProcess(), 1, &range, 0);
+#else
+    madvise(const_cast<unsigned char*>(data_), size_, MADV_WILLNEED);
+#endif
+    ++system_call_count;
+
+    volatile unsigned char sink = 0;
+    for (size_t offset = 0; offset < size_; offset += page_size)
+        sink = sink + data_[offset];
+}
+
+size_t mapped_file::get_system_call_count()
+{
+    return system_call_count;
+}
+
+bool mapped_file::is_open() const
+{
+    return data_ != nullptr;
+}
+
+const unsigned char* mapped_file::data() const
+{
+    return data_;
+}
+
+size_t mapped_file::size() const
+{
+    return size_;
+}
+
+void mapped_file::close()
+{
+#ifdef _WIN32
+    if (data_)
+        UnmapViewOfFile(data_);
+    if (mapping_handle_)
+        CloseHandle(mapping_handle_);
+    if (file_handle_)
+        CloseHandle(file_handle_);
+    system_call_count += (data_ != nullptr) + (mapping_handle_ != nullptr) + (file_handle_ != nullptr);
+    mapping_handle_ = nullptr;
+    file_handle_ = nullptr;
+#else
+    if (data_)
+    {
+        munmap(const_cast<unsigned char*>(data_), size_);
+        ++system_call_count;
+    }
+#endif
+    data_ = nullptr;
+    size_ = 0;
+}
@@ -0,0 +1,38 @@
+﻿#pragma once
+#include <cstddef>
+#include <string>
+
+// Read-only memory mapping of a whole file. The view stays valid for the lifetime of the object.
+class mapped_file
+{
+public:
+    mapped_file() = default;
+    explicit mapped_file(const std::string& path);
+    ~mapped_file();
+
+    mapped_file(const mapped_file&) = delete;
+    mapped_file& operator=(const mapped_file&) = delete;
+    mapped_file(mapped_file&& other) noexcept;
+    mapped_file& operator=(mapped_file&& other) noexcept;
+
+    bool is_open() const;
+    const unsigned char* data() const;
+    size_t size() const;
+
+    // Reads the whole view into memory on the calling thread, so later accesses from any thread don't fault on
+    // disk reads. The OS is asked to read ahead first, the touching makes sure it happened.
+    void prefetch() const;
+
+    // system calls made to open, map, read ahead and close files so far, across all mapped files
+    static size_t get_system_call_count();
+
+private:
+    const unsigned char* data_ = nullptr;
+    size_t size_ = 0;
+#ifdef _WIN32
+    void* file_handle_ = nullptr;
+    void* mapping_handle_ = nullptr;
+#endif
+
+    void close();
+};
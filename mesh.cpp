@@ -1,35 +1,279 @@
 // ReSharper disable CppClangTidyPerformanceNoIntToPtr
 #include "mesh.h"
 
+#include <algorithm>
+
 #include "glad/glad.h"
+#include "texture_array.h"
+#include "vertex_compression.h"
+
+draw_statistics frame_draw_statistics;
+
+namespace
+{
+    // set for every draw, hashed at compile time
+    constexpr uniform_id position_offset_uniform("positionOffset");
+    constexpr uniform_id position_scale_uniform("positionScale");
+    constexpr uniform_id octahedral_normals_uniform("octahedralNormals");
+}
+
+void draw_statistics::reset()
+{
+    *this = draw_statistics();
+}
+
+size_t mesh_geometry::get_vertex_size() const
+{
+    return format == vertex_format::compact ? sizeof(compact_vertex) : sizeof(vertex);
+}
+
+size_t mesh_geometry::get_index_size() const
+{
+    return index_type == GL_UNSIGNED_SHORT ? sizeof(std::uint16_t) : sizeof(unsigned int);
+}
+
+bool mesh_data::is_compact() const
+{
+    return !compact_vertices.empty();
+}
+
+mesh_geometry mesh_data::get_geometry() const
+{
+    mesh_geometry geometry;
+
+    if (is_compact())
+    {
+        geometry.format = vertex_format::compact;
+        geometry.vertices = compact_vertices.data();
+        geometry.vertex_count = compact_vertices.size();
+        geometry.position_offset = position_offset;
+        geometry.position_scale = position_scale;
+    }
+    else
+    {
+        geometry.vertices = vertices.data();
+        geometry.vertex_count = vertices.size();
+    }
+
+    if (!short_indices.empty())
+    {
+        geometry.index_type = GL_UNSIGNED_SHORT;
+        geometry.indices = short_indices.data();
+        geometry.index_count = short_indices.size();
+    }
+    else
+    {
+        geometry.indices = indices.data();
+        geometry.index_count = indices.size();
+    }
+
+    geometry.lods = lods;
+    geometry.bounds_center = bounds_center;
+    geometry.bounds_radius = bounds_radius;
+    geometry.meshlets = meshlets.data();
+    geometry.meshlet_count = meshlets.size();
+    return geometry;
+}
 
 mesh::mesh(std::vector<vertex> vertices, std::vector<unsigned> indices,
-           std::vector<texture> textures)
+           std::vector<texture> textures, const mesh_retention retention)
     :
     vertices(std::move(vertices)),
     indices(std::move(indices)),
     textures(std::move(textures)),
-    vao_(0), vbo_(0), ebo_(0)
+    vao_(0), vbo_(0), ebo_(0), index_count_(0), index_type_(GL_UNSIGNED_INT), format_(vertex_format::full),
+    position_offset_(0.0f), position_scale_(1.0f), bounds_center_(0.0f), bounds_radius_(0.0f)
 {
-    setup_mesh();
+    name_material_uniforms();
+
+    mesh_geometry geometry;
+    geometry.vertices = this->vertices.data();
+    geometry.vertex_count = this->vertices.size();
+    geometry.indices = this->indices.data();
+    geometry.index_count = this->indices.size();
+    setup_mesh(geometry);
+
+    if (retention != mesh_retention::all)
+    {
+        std::vector<vertex> uploaded_vertices;
+        std::vector<unsigned int> uploaded_indices;
+        this->vertices.swap(uploaded_vertices);
+        this->indices.swap(uploaded_indices);
+        geometry.vertices = uploaded_vertices.data();
+        geometry.indices = uploaded_indices.data();
+        retain_geometry(geometry, retention);
+    }
 }
 
-void mesh::draw(const shader& shader, const std::vector<extra_texture>& extra_textures, const GLenum mode) const
+mesh::mesh(const mesh_geometry& geometry, std::vector<texture> textures, const mesh_retention retention)
+    :
+    textures(std::move(textures)),
+    vao_(0), vbo_(0), ebo_(0), index_count_(0), index_type_(GL_UNSIGNED_INT), format_(vertex_format::full),
+    position_offset_(0.0f), position_scale_(1.0f), bounds_center_(0.0f), bounds_radius_(0.0f)
 {
-    unsigned int diffuse_number = 1, specular_number = 1;
+    name_material_uniforms();
+    setup_mesh(geometry);
+    retain_geometry(geometry, retention);
+}
 
-    for (unsigned int i = 0; i < textures.size(); i++)
+mesh::mesh(mesh_data&& data, std::vector<texture> textures, const mesh_retention retention)
+    :
+    textures(std::move(textures)),
+    vao_(0), vbo_(0), ebo_(0), index_count_(0), index_type_(GL_UNSIGNED_INT), format_(vertex_format::full),
+    position_offset_(0.0f), position_scale_(1.0f), bounds_center_(0.0f), bounds_radius_(0.0f)
+{
+    name_material_uniforms();
+
+    const auto geometry = data.get_geometry();
+    setup_mesh(geometry);
+
+    // full precision imports already hold exactly what is retained, so take them over instead of copying
+    if (retention == mesh_retention::all && !data.is_compact() && data.short_indices.empty())
     {
-        glActiveTexture(GL_TEXTURE0 + i);
+        vertices = std::move(data.vertices);
+        indices = std::move(data.indices);
+        return;
+    }
+
+    retain_geometry(geometry, retention);
+}
+
+void mesh::draw(const shader& shader, const std::vector<extra_texture>& extra_textures, const GLenum mode,
+                size_t lod) const
+{
+    bind_material(shader, extra_textures);
+
+    if (lod >= lods_.size())
+        lod = lods_.size() - 1;
+    const auto& range = lods_[lod];
+
+    glBindVertexArray(vao_);
+    glDrawElements(mode, static_cast<GLsizei>(range.index_count), index_type_,
+                   reinterpret_cast<void*>(range.index_offset * get_index_size()));
+
+    ++frame_draw_statistics.draw_calls;
+    if (mode == GL_TRIANGLES)
+        frame_draw_statistics.triangles += range.index_count / 3;
+    glBindVertexArray(0);
+
+    glActiveTexture(GL_TEXTURE0);
+}
+
+void mesh::draw(const shader& shader, const std::vector<extra_texture>& extra_textures, const meshlet_view& view) const
+{
+    if (meshlets_.empty())
+    {
+        draw(shader, extra_textures);
+        return;
+    }
+
+    visible_counts_.clear();
+    visible_offsets_.clear();
+    size_t visible_index_count = 0;
+    size_t range_end = ~size_t(0);
+    const size_t index_size = get_index_size();
+
+    for (const auto& meshlet : meshlets_)
+    {
+        if (!is_meshlet_visible(meshlet, view))
+        {
+            ++frame_draw_statistics.meshlets_culled;
+            continue;
+        }
+
+        ++frame_draw_statistics.meshlets_drawn;
+        visible_index_count += meshlet.index_count;
 
+        // meshlets are stored in order, so visible neighbours extend the previous range
+        if (meshlet.index_offset == range_end)
+        {
+            visible_counts_.back() += static_cast<GLsizei>(meshlet.index_count);
+        }
+        else
+        {
+            visible_counts_.push_back(static_cast<GLsizei>(meshlet.index_count));
+            visible_offsets_.push_back(reinterpret_cast<const void*>(meshlet.index_offset * index_size));
+        }
+        range_end = meshlet.index_offset + meshlet.index_count;
+    }
+
+    if (visible_counts_.empty())
+        return;
+
+    bind_material(shader, extra_textures);
+
+    glBindVertexArray(vao_);
+    glMultiDrawElements(GL_TRIANGLES, visible_counts_.data(), index_type_, visible_offsets_.data(),
+                        static_cast<GLsizei>(visible_counts_.size()));
+
+    ++frame_draw_statistics.draw_calls;
+    frame_draw_statistics.triangles += visible_index_count / 3;
+    glBindVertexArray(0);
+
+    glActiveTexture(GL_TEXTURE0);
+}
+
+size_t mesh::get_lod_count() const
+{
+    return lods_.size();
+}
+
+bool mesh::has_meshlets() const
+{
+    return !meshlets_.empty();
+}
+
+glm::vec3 mesh::get_bounds_center() const
+{
+    return bounds_center_;
+}
+
+float mesh::get_bounds_radius() const
+{
+    return bounds_radius_;
+}
+
+size_t mesh::get_resident_cpu_bytes() const
+{
+    return vertices.capacity() * sizeof(vertex) + positions.capacity() * sizeof(glm::vec3) +
+        indices.capacity() * sizeof(unsigned int) + lods_.capacity() * sizeof(mesh_lod) +
+        meshlets_.capacity() * sizeof(meshlet);
+}
+
+void mesh::name_material_uniforms()
+{
+    unsigned int diffuse_number = 1, specular_number = 1;
+
+    sampler_uniforms_.clear();
+    layer_uniforms_.clear();
+    for (const auto& texture : textures)
+    {
         std::string number;
-        std::string name = textures[i].type;
+        const std::string& name = texture.type;
         if (name == "texture_diffuse")
             number = std::to_string(diffuse_number++);
         else if (name == "texture_specular")
             number = std::to_string(specular_number++);
 
-        shader.set_int("material." + name + number, static_cast<int>(i));
+        sampler_uniforms_.emplace_back("material." + name + number);
+        layer_uniforms_.emplace_back("material." + name + number + "_layer");
+    }
+}
+
+void mesh::bind_material(const shader& shader, const std::vector<extra_texture>& extra_textures) const
+{
+    for (unsigned int i = 0; i < textures.size(); i++)
+    {
+        shader.set_int(sampler_uniforms_[i], static_cast<int>(i));
+        if (textures[i].array)
+        {
+            // props sharing the array only differ in the layer, the array itself stays bound between them
+            shader.set_int(layer_uniforms_[i], static_cast<int>(textures[i].layer));
+            texture_array_registry::instance().bind(i, *textures[i].array);
+            continue;
+        }
+
+        glActiveTexture(GL_TEXTURE0 + i);
         glBindTexture(GL_TEXTURE_2D, textures[i].id);
     }
 
@@ -43,15 +287,82 @@ void mesh::draw(const shader& shader, const std::vector<extra_texture>& extra_te
         glBindTexture(extra_texture.type, extra_texture.id);
     }
 
-    glBindVertexArray(vao_);
-    glDrawElements(mode, static_cast<GLsizei>(indices.size()), GL_UNSIGNED_INT, nullptr);
-    glBindVertexArray(0);
+    shader.set_vec3(position_offset_uniform, position_offset_);
+    shader.set_vec3(position_scale_uniform, position_scale_);
+    shader.set_bool(octahedral_normals_uniform, format_ == vertex_format::compact);
+}
 
-    glActiveTexture(GL_TEXTURE0);
+size_t mesh::get_index_size() const
+{
+    return index_type_ == GL_UNSIGNED_SHORT ? sizeof(std::uint16_t) : sizeof(unsigned int);
 }
 
-void mesh::setup_mesh()
+void mesh::retain_geometry(const mesh_geometry& geometry, const mesh_retention retention)
 {
+    vertices.clear();
+    vertices.shrink_to_fit();
+    positions.clear();
+    positions.shrink_to_fit();
+    indices.clear();
+    indices.shrink_to_fit();
+
+    if (retention == mesh_retention::discard)
+        return;
+
+    indices.resize(geometry.index_count);
+    if (geometry.index_type == GL_UNSIGNED_SHORT)
+    {
+        const auto* short_indices = static_cast<const std::uint16_t*>(geometry.indices);
+        std::copy(short_indices, short_indices + geometry.index_count, indices.begin());
+    }
+    else
+    {
+        const auto* int_indices = static_cast<const unsigned int*>(geometry.indices);
+        std::copy(int_indices, int_indices + geometry.index_count, indices.begin());
+    }
+
+    const auto* compact_vertices = static_cast<const compact_vertex*>(geometry.vertices);
+    const auto* full_vertices = static_cast<const vertex*>(geometry.vertices);
+    const bool compact = geometry.format == vertex_format::compact;
+
+    if (retention == mesh_retention::positions)
+    {
+        positions.resize(geometry.vertex_count);
+        for (size_t i = 0; i < geometry.vertex_count; ++i)
+        {
+            positions[i] = compact
+                               ? decompress_position(compact_vertices[i], geometry.position_offset,
+                                                     geometry.position_scale)
+                               : full_vertices[i].position;
+        }
+        return;
+    }
+
+    if (!compact)
+    {
+        vertices.assign(full_vertices, full_vertices + geometry.vertex_count);
+        return;
+    }
+
+    vertices.resize(geometry.vertex_count);
+    for (size_t i = 0; i < geometry.vertex_count; ++i)
+        vertices[i] = decompress_vertex(compact_vertices[i], geometry.position_offset, geometry.position_scale);
+}
+
+void mesh::setup_mesh(const mesh_geometry& geometry)
+{
+    index_count_ = geometry.index_count;
+    index_type_ = geometry.index_type;
+    format_ = geometry.format;
+    position_offset_ = geometry.position_offset;
+    position_scale_ = geometry.position_scale;
+    lods_ = geometry.lods;
+    if (lods_.empty())
+        lods_.push_back({0, index_count_, 0.0f});
+    bounds_center_ = geometry.bounds_center;
+    bounds_radius_ = geometry.bounds_radius;
+    meshlets_.assign(geometry.meshlets, geometry.meshlets + geometry.meshlet_count);
+
     glGenVertexArrays(1, &vao_);
     glGenBuffers(1, &vbo_);
     glGenBuffers(1, &ebo_);
@@ -59,23 +370,42 @@ void mesh::setup_mesh()
     glBindVertexArray(vao_);
     glBindBuffer(GL_ARRAY_BUFFER, vbo_);
 
-    glBufferData(GL_ARRAY_BUFFER, static_cast<GLsizeiptr>(vertices.size() * sizeof(vertex)), vertices.data(),
-                 GL_STATIC_DRAW);
+    glBufferData(GL_ARRAY_BUFFER, static_cast<GLsizeiptr>(geometry.vertex_count * geometry.get_vertex_size()),
+                 geometry.vertices, GL_STATIC_DRAW);
 
     glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ebo_);
-    glBufferData(GL_ELEMENT_ARRAY_BUFFER, static_cast<GLsizeiptr>(indices.size() * sizeof(unsigned)), indices.data(),
-                 GL_STATIC_DRAW);
-
-    // positions
-    glEnableVertexAttribArray(0);
-    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(vertex), static_cast<void*>(nullptr));
-    // normals
-    glEnableVertexAttribArray(1);
-    glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(vertex), reinterpret_cast<void*>(offsetof(vertex, normal)));
-    // tex coords
-    glEnableVertexAttribArray(2);
-    glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, sizeof(vertex),
-                          reinterpret_cast<void*>(offsetof(vertex, tex_coords)));
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, static_cast<GLsizeiptr>(geometry.index_count * geometry.get_index_size()),
+                 geometry.indices, GL_STATIC_DRAW);
+
+    if (format_ == vertex_format::compact)
+    {
+        // positions, normalized to the mesh bounds
+        glEnableVertexAttribArray(0);
+        glVertexAttribPointer(0, 3, GL_UNSIGNED_SHORT, GL_TRUE, sizeof(compact_vertex),
+                              reinterpret_cast<void*>(offsetof(compact_vertex, position)));
+        // octahedral normals, decoded in the vertex shader
+        glEnableVertexAttribArray(1);
+        glVertexAttribPointer(1, 2, GL_SHORT, GL_TRUE, sizeof(compact_vertex),
+                              reinterpret_cast<void*>(offsetof(compact_vertex, normal)));
+        // tex coords
+        glEnableVertexAttribArray(2);
+        glVertexAttribPointer(2, 2, GL_HALF_FLOAT, GL_FALSE, sizeof(compact_vertex),
+                              reinterpret_cast<void*>(offsetof(compact_vertex, tex_coords)));
+    }
+    else
+    {
+        // positions
+        glEnableVertexAttribArray(0);
+        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(vertex), static_cast<void*>(nullptr));
+        // normals
+        glEnableVertexAttribArray(1);
+        glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(vertex),
+                              reinterpret_cast<void*>(offsetof(vertex, normal)));
+        // tex coords
+        glEnableVertexAttribArray(2);
+        glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, sizeof(vertex),
+                              reinterpret_cast<void*>(offsetof(vertex, tex_coords)));
+    }
 
     glBindVertexArray(0);
 }
@@ -1,10 +1,12 @@
 ﻿#pragma once
 
+#include <cstdint>
 #include <string>
 #include <vector>
 #include <assimp/types.h>
 #include <glm/glm.hpp>
 
+#include "meshlet.h"
 #include "shader.h"
 
 struct vertex
@@ -14,32 +16,176 @@ struct vertex
     glm::vec2 tex_coords;
 };
 
+// 16 byte vertex: position quantized to the mesh bounds (unorm16), octahedral normal (snorm16),
+// half float texture coordinates
+struct compact_vertex
+{
+    std::uint16_t position[3];
+    std::uint16_t padding;
+    std::int16_t normal[2];
+    std::uint16_t tex_coords[2];
+};
+
+enum class vertex_format : std::uint32_t
+{
+    full,
+    compact,
+};
+
+// range of the index buffer holding one level of detail, all levels share the vertex buffer
+struct mesh_lod
+{
+    size_t index_offset;
+    size_t index_count;
+    // simplification error relative to the mesh extent
+    float error;
+};
+
+// GPU-ready vertex and index data, in the layout given by format and index_type
+struct mesh_geometry
+{
+    vertex_format format = vertex_format::full;
+    const void* vertices = nullptr;
+    size_t vertex_count = 0;
+    GLenum index_type = GL_UNSIGNED_INT;
+    const void* indices = nullptr;
+    size_t index_count = 0;
+    // compact positions are reconstructed as offset + scale * quantized position
+    glm::vec3 position_offset = glm::vec3(0.0f);
+    glm::vec3 position_scale = glm::vec3(1.0f);
+    // empty means a single level covering all indices
+    std::vector<mesh_lod> lods;
+    glm::vec3 bounds_center = glm::vec3(0.0f);
+    float bounds_radius = 0.0f;
+    // clusters of the full detail level, may be empty
+    const meshlet* meshlets = nullptr;
+    size_t meshlet_count = 0;
+
+    size_t get_vertex_size() const;
+    size_t get_index_size() const;
+};
+
+class texture_array;
+
 struct texture
 {
+    // GL_TEXTURE_2D, 0 for a texture packed into a texture array
     unsigned int id;
     std::string type;
     std::string path;
+    // set for textures packed by texture_array_registry, see texture_array.h
+    const texture_array* array = nullptr;
+    unsigned int layer = 0;
+};
+
+// a texture as referenced by a material, before it is loaded
+struct texture_reference
+{
+    std::string type;
+    std::string path;
+};
+
+// CPU-side result of importing a mesh, ready to be uploaded or cached
+struct mesh_data
+{
+    std::vector<vertex> vertices;
+    std::vector<unsigned int> indices;
+    std::vector<texture_reference> textures;
+
+    // filled when the mesh is compressed, vertices and indices are empty then
+    std::vector<compact_vertex> compact_vertices;
+    std::vector<std::uint16_t> short_indices;
+    glm::vec3 position_offset = glm::vec3(0.0f);
+    glm::vec3 position_scale = glm::vec3(1.0f);
+
+    // levels of detail stored one after the other in the index buffer, empty if only the full mesh exists
+    std::vector<mesh_lod> lods;
+    glm::vec3 bounds_center = glm::vec3(0.0f);
+    float bounds_radius = 0.0f;
+    std::vector<meshlet> meshlets;
+
+    bool is_compact() const;
+    mesh_geometry get_geometry() const;
+};
+
+// counters for the current frame, reset by the caller at the start of each frame
+struct draw_statistics
+{
+    size_t draw_calls = 0;
+    size_t triangles = 0;
+    size_t meshlets_drawn = 0;
+    size_t meshlets_culled = 0;
+
+    void reset();
+};
+
+extern draw_statistics frame_draw_statistics;
+
+// What a mesh keeps in CPU memory once its geometry has been uploaded
+enum class mesh_retention
+{
+    // nothing, the GPU buffers are the only copy
+    discard,
+    // positions and 32-bit indices, e.g. for picking or CPU-side culling
+    positions,
+    // full precision vertices and 32-bit indices, compact meshes are decoded for this
+    all,
 };
 
 struct extra_texture
 {
     unsigned int id;
-    std::string uniform_name;
+    uniform_id uniform_name;
     GLenum type;
 };
 
 class mesh
 {
 public:
+    // filled according to the mesh_retention the mesh was created with
     std::vector<vertex> vertices;
+    std::vector<glm::vec3> positions;
     std::vector<unsigned int> indices;
     std::vector<texture> textures;
 
-    mesh(std::vector<vertex> vertices, std::vector<unsigned int> indices, std::vector<texture> textures);
+    mesh(std::vector<vertex> vertices, std::vector<unsigned int> indices, std::vector<texture> textures,
+         mesh_retention retention = mesh_retention::all);
+    // uploads straight from external memory (e.g. a mapped cache file), retained data is copied out of it
+    mesh(const mesh_geometry& geometry, std::vector<texture> textures,
+         mesh_retention retention = mesh_retention::discard);
+    // retaining everything takes over the full precision vertices and indices of imported data without a copy
+    mesh(mesh_data&& data, std::vector<texture> textures, mesh_retention retention = mesh_retention::discard);
+
+    void draw(const shader& shader, const std::vector<extra_texture>& extra_textures, GLenum mode = GL_TRIANGLES,
+              size_t lod = 0) const;
+    // draws the full detail level, skipping meshlets outside the frustum or facing away from the camera
+    void draw(const shader& shader, const std::vector<extra_texture>& extra_textures, const meshlet_view& view) const;
 
-    void draw(const shader& shader, const std::vector<extra_texture>& extra_textures, GLenum mode = GL_TRIANGLES) const;
+    size_t get_lod_count() const;
+    bool has_meshlets() const;
+    glm::vec3 get_bounds_center() const;
+    float get_bounds_radius() const;
+    // CPU memory held for the mesh: the retained geometry plus what drawing needs (levels, meshlets)
+    size_t get_resident_cpu_bytes() const;
 
 private:
     unsigned int vao_, vbo_, ebo_;
-    void setup_mesh();
+    size_t index_count_;
+    GLenum index_type_;
+    vertex_format format_;
+    glm::vec3 position_offset_, position_scale_;
+    std::vector<mesh_lod> lods_;
+    glm::vec3 bounds_center_;
+    float bounds_radius_;
+    std::vector<meshlet> meshlets_;
+    // ranges of visible meshlets for glMultiDrawElements, reused between frames
+    mutable std::vector<GLsizei> visible_counts_;
+    mutable std::vector<const void*> visible_offsets_;
+    // "material.texture_diffuseN" style sampler names of the textures and their "_layer" companions, built once
+    std::vector<uniform_id> sampler_uniforms_, layer_uniforms_;
+    void setup_mesh(const mesh_geometry& geometry);
+    void name_material_uniforms();
+    void retain_geometry(const mesh_geometry& geometry, mesh_retention retention);
+    void bind_material(const shader& shader, const std::vector<extra_texture>& extra_textures) const;
+    size_t get_index_size() const;
 };
@@ -0,0 +1,248 @@
+﻿#include "mesh_cache.h"
+
+#include <cstring>
+#include <iostream>
+
+#include "asset_io.h"
+#include "binary_io.h"
+#include "hash.h"
+
+namespace
+{
+    constexpr char cache_magic[4] = {'L', 'O', 'G', 'M'};
+    constexpr size_t data_alignment = binary_data_alignment;
+
+    struct file_header
+    {
+        char magic[4];
+        std::uint32_t version;
+        std::uint64_t key;
+        std::uint32_t mesh_count;
+        std::uint32_t reserved;
+    };
+
+    struct mesh_header
+    {
+        vertex_format format;
+        std::uint32_t index_size;
+        std::uint32_t vertex_count;
+        std::uint32_t index_count;
+        std::uint32_t texture_count;
+        std::uint32_t lod_count;
+        std::uint32_t meshlet_count;
+        float position_offset[3];
+        float position_scale[3];
+        float bounds_center[3];
+        float bounds_radius;
+    };
+
+    struct lod_entry
+    {
+        std::uint32_t index_offset;
+        std::uint32_t index_count;
+        float error;
+    };
+}
+
+std::uint64_t mesh_cache::make_key(const std::vector<std::string>& inputs, const std::uint64_t params_hash)
+{
+    std::uint64_t key = hash_value(version);
+    key = hash_value(params_hash, key);
+
+    for (size_t i = 0; i < inputs.size(); ++i)
+    {
+        const auto input = asset_io::instance().open(inputs[i]);
+        if (!input->is_open() && i == 0)
+            return 0;
+
+        // the importer goes on without a missing material library, adding it later has to change the key as well
+        key = hash_string(inputs[i], key);
+        key = hash_value(input->is_open(), key);
+        if (input->is_open())
+            key = hash_bytes(input->data(), input->size(), key);
+    }
+
+    return key;
+}
+
+std::vector<unsigned char> mesh_cache::serialize(const std::uint64_t key, const std::vector<mesh_data>& meshes)
+{
+    std::vector<unsigned char> buffer;
+    binary_writer writer(buffer);
+
+    file_header header{};
+    std::memcpy(header.magic, cache_magic, sizeof cache_magic);
+    header.version = version;
+    header.key = key;
+    header.mesh_count = static_cast<std::uint32_t>(meshes.size());
+    writer.write(&header, sizeof header);
+
+    for (const auto& mesh : meshes)
+    {
+        const auto geometry = mesh.get_geometry();
+
+        mesh_header mesh_header{};
+        mesh_header.format = geometry.format;
+        mesh_header.index_size = static_cast<std::uint32_t>(geometry.get_index_size());
+        mesh_header.vertex_count = static_cast<std::uint32_t>(geometry.vertex_count);
+        mesh_header.index_count = static_cast<std::uint32_t>(geometry.index_count);
+        mesh_header.texture_count = static_cast<std::uint32_t>(mesh.textures.size());
+        mesh_header.lod_count = static_cast<std::uint32_t>(geometry.lods.size());
+        mesh_header.meshlet_count = static_cast<std::uint32_t>(geometry.meshlet_count);
+        for (int axis = 0; axis < 3; ++axis)
+        {
+            mesh_header.position_offset[axis] = geometry.position_offset[axis];
+            mesh_header.position_scale[axis] = geometry.position_scale[axis];
+            mesh_header.bounds_center[axis] = geometry.bounds_center[axis];
+        }
+        mesh_header.bounds_radius = geometry.bounds_radius;
+        writer.write(&mesh_header, sizeof mesh_header);
+
+        for (const auto& lod : geometry.lods)
+        {
+            const lod_entry entry = {static_cast<std::uint32_t>(lod.index_offset),
+                                     static_cast<std::uint32_t>(lod.index_count), lod.error};
+            writer.write(&entry, sizeof entry);
+        }
+
+        for (const auto& texture : mesh.textures)
+        {
+            writer.write_string(texture.type);
+            writer.write_string(texture.path);
+        }
+
+        writer.pad_to(data_alignment);
+        writer.write(geometry.vertices, geometry.vertex_count * geometry.get_vertex_size());
+        writer.pad_to(data_alignment);
+        writer.write(geometry.indices, geometry.index_count * geometry.get_index_size());
+        writer.pad_to(data_alignment);
+        writer.write(geometry.meshlets, geometry.meshlet_count * sizeof(meshlet));
+        writer.pad_to(data_alignment);
+    }
+
+    return buffer;
+}
+
+bool mesh_cache::store(const std::uint64_t key, const std::vector<mesh_data>& meshes)
+{
+    const auto path = get_path(key);
+    if (!write_file_atomically(path, serialize(key, meshes)))
+    {
+        std::cout << "ERROR::MESH_CACHE::FILE_NOT_WRITTEN " << path << std::endl;
+        return false;
+    }
+
+    return true;
+}
+
+mesh_cache::mesh_cache(const std::uint64_t key) : file_(asset_io::instance().open(get_path(key))), valid_(false)
+{
+    if (file_->is_open())
+        valid_ = deserialize(file_->data(), file_->size(), key, meshes_);
+}
+
+bool mesh_cache::is_valid() const
+{
+    return valid_;
+}
+
+const std::vector<cached_mesh>& mesh_cache::get_meshes() const
+{
+    return meshes_;
+}
+
+std::string mesh_cache::get_path(const std::uint64_t key)
+{
+    return std::string(directory) + '/' + hash_to_hex(key) + ".mesh";
+}
+
+bool mesh_cache::deserialize(const unsigned char* data, const size_t size, const std::uint64_t key,
+                             std::vector<cached_mesh>& meshes)
+{
+    binary_reader reader(data, size);
+
+    file_header header{};
+    const auto header_data = reader.read(sizeof header);
+    if (!header_data)
+        return false;
+    std::memcpy(&header, header_data, sizeof header);
+
+    if (std::memcmp(header.magic, cache_magic, sizeof cache_magic) != 0 || header.version != version ||
+        header.key != key)
+        return false;
+
+    meshes.clear();
+    meshes.reserve(header.mesh_count);
+
+    for (std::uint32_t mesh_index = 0; mesh_index < header.mesh_count; ++mesh_index)
+    {
+        mesh_header mesh_header{};
+        const auto mesh_header_data = reader.read(sizeof mesh_header);
+        if (!mesh_header_data)
+            return false;
+        std::memcpy(&mesh_header, mesh_header_data, sizeof mesh_header);
+
+        cached_mesh mesh{};
+
+        for (std::uint32_t lod_index = 0; lod_index < mesh_header.lod_count; ++lod_index)
+        {
+            lod_entry entry{};
+            const auto entry_data = reader.read(sizeof entry);
+            if (!entry_data)
+                return false;
+            std::memcpy(&entry, entry_data, sizeof entry);
+            if (static_cast<size_t>(entry.index_offset) + entry.index_count > mesh_header.index_count)
+                return false;
+            mesh.geometry.lods.push_back({entry.index_offset, entry.index_count, entry.error});
+        }
+
+        for (std::uint32_t texture_index = 0; texture_index < mesh_header.texture_count; ++texture_index)
+        {
+            texture_reference texture;
+            if (!reader.read_string(texture.type) || !reader.read_string(texture.path))
+                return false;
+            mesh.textures.push_back(std::move(texture));
+        }
+
+        auto& geometry = mesh.geometry;
+        if (mesh_header.format != vertex_format::full && mesh_header.format != vertex_format::compact)
+            return false;
+        if (mesh_header.index_size != sizeof(std::uint16_t) && mesh_header.index_size != sizeof(unsigned int))
+            return false;
+        geometry.format = mesh_header.format;
+        geometry.index_type = mesh_header.index_size == sizeof(std::uint16_t) ? GL_UNSIGNED_SHORT : GL_UNSIGNED_INT;
+        geometry.vertex_count = mesh_header.vertex_count;
+        geometry.index_count = mesh_header.index_count;
+        geometry.position_offset = glm::vec3(mesh_header.position_offset[0], mesh_header.position_offset[1],
+                                             mesh_header.position_offset[2]);
+        geometry.position_scale = glm::vec3(mesh_header.position_scale[0], mesh_header.position_scale[1],
+                                            mesh_header.position_scale[2]);
+        geometry.bounds_center = glm::vec3(mesh_header.bounds_center[0], mesh_header.bounds_center[1],
+                                           mesh_header.bounds_center[2]);
+        geometry.bounds_radius = mesh_header.bounds_radius;
+
+        if (!reader.skip_to(data_alignment))
+            return false;
+        geometry.vertices = reader.read(geometry.vertex_count * geometry.get_vertex_size());
+        if (!reader.skip_to(data_alignment))
+            return false;
+        geometry.indices = reader.read(geometry.index_count * geometry.get_index_size());
+        if (!geometry.vertices || !geometry.indices || !reader.skip_to(data_alignment))
+            return false;
+        geometry.meshlet_count = mesh_header.meshlet_count;
+        geometry.meshlets = reinterpret_cast<const meshlet*>(reader.read(geometry.meshlet_count * sizeof(meshlet)));
+        if (!geometry.meshlets || !reader.skip_to(data_alignment))
+            return false;
+        for (size_t i = 0; i < geometry.meshlet_count; ++i)
+        {
+            if (static_cast<size_t>(geometry.meshlets[i].index_offset) + geometry.meshlets[i].index_count >
+                geometry.index_count)
+                return false;
+        }
+
+        // the mapping is page-aligned and every block starts on a 16 byte boundary, so the data is used in place
+        meshes.push_back(std::move(mesh));
+    }
+
+    return true;
+}
@@ -0,0 +1,47 @@
+﻿#pragma once
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "mapped_file.h"
+#include "mesh.h"
+
+// A mesh as stored in the cache file. The geometry points into the mapped file.
+struct cached_mesh
+{
+    mesh_geometry geometry;
+    std::vector<texture_reference> textures;
+};
+
+// Flat binary cache of imported meshes, keyed by the contents of the source file and the files it pulls in, and the
+// import parameters.
+class mesh_cache
+{
+public:
+    // bump whenever the layout of the file or of the vertex structs changes, or the processing that produces the data
+    static constexpr std::uint32_t version = 5;
+    static constexpr const char* directory = "./cache";
+
+    // inputs are the source file followed by the files the importer reads along with it, e.g. an OBJ file's material
+    // libraries; returns 0 if the source file cannot be read
+    static std::uint64_t make_key(const std::vector<std::string>& inputs, std::uint64_t params_hash);
+    static bool store(std::uint64_t key, const std::vector<mesh_data>& meshes);
+    // the file contents, also embedded as is in cooked asset packages
+    static std::vector<unsigned char> serialize(std::uint64_t key, const std::vector<mesh_data>& meshes);
+    // the geometry of the parsed meshes points into data, which has to outlive them
+    static bool deserialize(const unsigned char* data, size_t size, std::uint64_t key,
+                            std::vector<cached_mesh>& meshes);
+
+    explicit mesh_cache(std::uint64_t key);
+
+    bool is_valid() const;
+    const std::vector<cached_mesh>& get_meshes() const;
+
+private:
+    std::shared_ptr<const mapped_file> file_;
+    std::vector<cached_mesh> meshes_;
+    bool valid_;
+
+    static std::string get_path(std::uint64_t key);
+};
@@ -0,0 +1,801 @@
+﻿#include "mesh_optimizer.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <numeric>
+#include <unordered_map>
+
+namespace
+{
+    constexpr unsigned int invalid_index = ~0u;
+
+    // triangles using each vertex, stored as one flat list with per-vertex offsets
+    struct triangle_adjacency
+    {
+        std::vector<unsigned int> offsets;
+        std::vector<unsigned int> counts;
+        std::vector<unsigned int> triangles;
+
+        triangle_adjacency(const std::vector<unsigned int>& indices, const size_t vertex_count) :
+            offsets(vertex_count + 1, 0), counts(vertex_count, 0), triangles(indices.size())
+        {
+            for (const auto index : indices)
+                ++counts[index];
+
+            for (size_t i = 0; i < vertex_count; ++i)
+                offsets[i + 1] = offsets[i] + counts[i];
+
+            std::vector<unsigned int> cursor(offsets.begin(), offsets.end() - 1);
+            for (size_t i = 0; i < indices.size(); ++i)
+                triangles[cursor[indices[i]]++] = static_cast<unsigned int>(i / 3);
+        }
+    };
+
+    class fifo_cache
+    {
+    public:
+        explicit fifo_cache(const size_t vertex_count) : timestamps_(vertex_count, 0), time_(0)
+        {
+        }
+
+        // returns true on a miss
+        bool access(const unsigned int index, const unsigned int cache_size)
+        {
+            if (time_ - timestamps_[index] < cache_size && timestamps_[index] != 0)
+                return false;
+
+            timestamps_[index] = ++time_;
+            return true;
+        }
+
+        void reset()
+        {
+            // pushing everything out is cheaper than clearing the timestamps
+            time_ += static_cast<unsigned int>(timestamps_.size()) + 1;
+        }
+
+    private:
+        std::vector<unsigned int> timestamps_;
+        unsigned int time_;
+    };
+
+    bool is_near(const vertex& a, const vertex& b, const float epsilon)
+    {
+        const auto near = [epsilon](const float x, const float y) { return std::abs(x - y) <= epsilon; };
+        return near(a.position.x, b.position.x) && near(a.position.y, b.position.y) &&
+            near(a.position.z, b.position.z) &&
+            near(a.normal.x, b.normal.x) && near(a.normal.y, b.normal.y) && near(a.normal.z, b.normal.z) &&
+            near(a.tex_coords.x, b.tex_coords.x) && near(a.tex_coords.y, b.tex_coords.y);
+    }
+
+    std::uint64_t make_cell_key(const std::int64_t x, const std::int64_t y, const std::int64_t z)
+    {
+        // 21 bits per axis is plenty for any mesh we load at sensible epsilons, wrapping only costs extra comparisons
+        constexpr std::uint64_t mask = (1ull << 21) - 1;
+        return (static_cast<std::uint64_t>(x) & mask) | (static_cast<std::uint64_t>(y) & mask) << 21 |
+            (static_cast<std::uint64_t>(z) & mask) << 42;
+    }
+
+    // symmetric 4x4 matrix of a weighted sum of squared plane distances, and the total weight of the planes
+    struct quadric
+    {
+        double a00, a01, a02, a03, a11, a12, a13, a22, a23, a33;
+        double weight;
+
+        void add_plane(const glm::vec3& normal, const double d, const double plane_weight)
+        {
+            const double x = normal.x, y = normal.y, z = normal.z;
+            a00 += plane_weight * x * x;
+            a01 += plane_weight * x * y;
+            a02 += plane_weight * x * z;
+            a03 += plane_weight * x * d;
+            a11 += plane_weight * y * y;
+            a12 += plane_weight * y * z;
+            a13 += plane_weight * y * d;
+            a22 += plane_weight * z * z;
+            a23 += plane_weight * z * d;
+            a33 += plane_weight * d * d;
+            weight += plane_weight;
+        }
+
+        void add(const quadric& other)
+        {
+            a00 += other.a00;
+            a01 += other.a01;
+            a02 += other.a02;
+            a03 += other.a03;
+            a11 += other.a11;
+            a12 += other.a12;
+            a13 += other.a13;
+            a22 += other.a22;
+            a23 += other.a23;
+            a33 += other.a33;
+            weight += other.weight;
+        }
+
+        // weighted mean of the squared distances, so the error stays a squared distance whatever the triangle areas
+        double evaluate(const glm::vec3& point) const
+        {
+            if (weight == 0.0)
+                return 0.0;
+
+            const double x = point.x, y = point.y, z = point.z;
+            const double result = a00 * x * x + 2 * a01 * x * y + 2 * a02 * x * z + 2 * a03 * x +
+                a11 * y * y + 2 * a12 * y * z + 2 * a13 * y +
+                a22 * z * z + 2 * a23 * z + a33;
+            return std::max(result / weight, 0.0);
+        }
+    };
+
+    struct collapse
+    {
+        unsigned int from;
+        unsigned int to;
+        double error;
+    };
+
+    std::uint64_t make_position_key(const glm::vec3& position)
+    {
+        std::uint32_t bits[3];
+        std::memcpy(bits, &position, sizeof bits);
+        return (static_cast<std::uint64_t>(bits[0]) * 73856093u) ^ (static_cast<std::uint64_t>(bits[1]) * 19349663u) ^
+            (static_cast<std::uint64_t>(bits[2]) * 83492791u);
+    }
+
+    // true if moving corner `from` of the triangle to `to_position` keeps the triangle facing the same way
+    bool keeps_orientation(const glm::vec3& a, const glm::vec3& b, const glm::vec3& c, const int moved_corner,
+                           const glm::vec3& to_position)
+    {
+        const glm::vec3 before = cross(b - a, c - a);
+        const glm::vec3 new_a = moved_corner == 0 ? to_position : a;
+        const glm::vec3 new_b = moved_corner == 1 ? to_position : b;
+        const glm::vec3 new_c = moved_corner == 2 ? to_position : c;
+        const glm::vec3 after = cross(new_b - new_a, new_c - new_a);
+        return dot(before, after) > 0.0f;
+    }
+
+    size_t count_misses(const std::vector<unsigned int>& indices, const size_t begin, const size_t end,
+                        fifo_cache& cache, const unsigned int cache_size)
+    {
+        size_t misses = 0;
+        for (size_t i = begin * 3; i < end * 3; ++i)
+            misses += cache.access(indices[i], cache_size) ? 1 : 0;
+        return misses;
+    }
+}
+
+size_t weld_vertices(std::vector<vertex>& vertices, std::vector<unsigned int>& indices, const float epsilon)
+{
+    // positions are bucketed into a grid of epsilon sized cells, so any match is in the same or a neighbouring cell
+    constexpr float min_cell_size = 1e-6f;
+    const float cell_size = std::max(epsilon, min_cell_size);
+    const int search_radius = epsilon > 0.0f ? 1 : 0;
+
+    std::unordered_map<std::uint64_t, unsigned int> cell_heads;
+    cell_heads.reserve(vertices.size());
+    std::vector<unsigned int> next_in_cell;
+    next_in_cell.reserve(vertices.size());
+
+    std::vector<vertex> welded;
+    welded.reserve(vertices.size());
+    std::vector<unsigned int> remap(vertices.size());
+
+    for (size_t i = 0; i < vertices.size(); ++i)
+    {
+        const auto& vertex = vertices[i];
+        const auto cell_x = static_cast<std::int64_t>(std::floor(vertex.position.x / cell_size));
+        const auto cell_y = static_cast<std::int64_t>(std::floor(vertex.position.y / cell_size));
+        const auto cell_z = static_cast<std::int64_t>(std::floor(vertex.position.z / cell_size));
+
+        unsigned int match = invalid_index;
+        for (int dx = -search_radius; dx <= search_radius && match == invalid_index; ++dx)
+        {
+            for (int dy = -search_radius; dy <= search_radius && match == invalid_index; ++dy)
+            {
+                for (int dz = -search_radius; dz <= search_radius && match == invalid_index; ++dz)
+                {
+                    const auto head = cell_heads.find(make_cell_key(cell_x + dx, cell_y + dy, cell_z + dz));
+                    if (head == cell_heads.end())
+                        continue;
+
+                    for (auto candidate = head->second; candidate != invalid_index; candidate = next_in_cell[candidate])
+                    {
+                        if (is_near(vertex, welded[candidate], epsilon))
+                        {
+                            match = candidate;
+                            break;
+                        }
+                    }
+                }
+            }
+        }
+
+        if (match == invalid_index)
+        {
+            match = static_cast<unsigned int>(welded.size());
+            welded.push_back(vertex);
+
+            const auto [head, inserted] = cell_heads.emplace(make_cell_key(cell_x, cell_y, cell_z), match);
+            next_in_cell.push_back(inserted ? invalid_index : head->second);
+            head->second = match;
+        }
+
+        remap[i] = match;
+    }
+
+    for (auto& index : indices)
+        index = remap[index];
+
+    const size_t removed = vertices.size() - welded.size();
+    vertices.swap(welded);
+    return removed;
+}
+
+vertex_cache_statistics analyze_vertex_cache(const std::vector<unsigned int>& indices, const size_t vertex_count,
+                                             const unsigned int cache_size)
+{
+    vertex_cache_statistics statistics{0.0f, 0.0f};
+    if (indices.empty())
+        return statistics;
+
+    fifo_cache cache(vertex_count);
+    const size_t misses = count_misses(indices, 0, indices.size() / 3, cache, cache_size);
+
+    std::vector<bool> used(vertex_count, false);
+    size_t unique_vertices = 0;
+    for (const auto index : indices)
+    {
+        if (!used[index])
+        {
+            used[index] = true;
+            ++unique_vertices;
+        }
+    }
+
+    statistics.acmr = static_cast<float>(misses) / static_cast<float>(indices.size() / 3);
+    statistics.atvr = static_cast<float>(misses) / static_cast<float>(unique_vertices);
+    return statistics;
+}
+
+void optimize_vertex_cache(std::vector<unsigned int>& indices, const size_t vertex_count,
+                           const unsigned int cache_size)
+{
+    const size_t triangle_count = indices.size() / 3;
+    if (triangle_count == 0)
+        return;
+
+    const triangle_adjacency adjacency(indices, vertex_count);
+    std::vector<unsigned int> live_triangles = adjacency.counts;
+    std::vector<unsigned int> cache_time(vertex_count, 0);
+    std::vector<bool> emitted(triangle_count, false);
+    std::vector<unsigned int> dead_end_stack;
+    std::vector<unsigned int> candidates;
+
+    std::vector<unsigned int> result;
+    result.reserve(indices.size());
+
+    unsigned int time = cache_size + 1;
+    size_t cursor = 0;
+    unsigned int fanning_vertex = 0;
+    while (fanning_vertex < vertex_count && live_triangles[fanning_vertex] == 0)
+        ++fanning_vertex;
+
+    while (fanning_vertex != invalid_index && fanning_vertex < vertex_count)
+    {
+        candidates.clear();
+
+        // emit every remaining triangle around the fanning vertex
+        const auto begin = adjacency.offsets[fanning_vertex];
+        const auto end = adjacency.offsets[fanning_vertex + 1];
+        for (auto i = begin; i < end; ++i)
+        {
+            const auto triangle = adjacency.triangles[i];
+            if (emitted[triangle])
+                continue;
+
+            for (unsigned int corner = 0; corner < 3; ++corner)
+            {
+                const auto index = indices[triangle * 3 + corner];
+                result.push_back(index);
+                dead_end_stack.push_back(index);
+                candidates.push_back(index);
+                --live_triangles[index];
+
+                if (time - cache_time[index] > cache_size)
+                    cache_time[index] = time++;
+            }
+
+            emitted[triangle] = true;
+        }
+
+        // pick the candidate that is still in the cache and will stay there the longest once its fan is emitted
+        unsigned int next_vertex = invalid_index;
+        int best_priority = -1;
+        for (const auto candidate : candidates)
+        {
+            if (live_triangles[candidate] == 0)
+                continue;
+
+            int priority = 0;
+            if (time - cache_time[candidate] + 2 * live_triangles[candidate] <= cache_size)
+                priority = static_cast<int>(time - cache_time[candidate]);
+
+            if (priority > best_priority)
+            {
+                best_priority = priority;
+                next_vertex = candidate;
+            }
+        }
+
+        // dead end: fall back to recently used vertices, then to the input order
+        while (next_vertex == invalid_index && !dead_end_stack.empty())
+        {
+            const auto index = dead_end_stack.back();
+            dead_end_stack.pop_back();
+            if (live_triangles[index] > 0)
+                next_vertex = index;
+        }
+
+        while (next_vertex == invalid_index && cursor < vertex_count)
+        {
+            if (live_triangles[cursor] > 0)
+                next_vertex = static_cast<unsigned int>(cursor);
+            ++cursor;
+        }
+
+        fanning_vertex = next_vertex;
+    }
+
+    indices.swap(result);
+}
+
+void optimize_overdraw(std::vector<unsigned int>& indices, const std::vector<vertex>& vertices, const float threshold,
+                       const unsigned int cache_size)
+{
+    const size_t triangle_count = indices.size() / 3;
+    if (triangle_count == 0)
+        return;
+
+    // hard boundaries: triangles where the cache was effectively flushed (all three vertices missed)
+    std::vector<size_t> hard_clusters;
+    {
+        fifo_cache cache(vertices.size());
+        for (size_t triangle = 0; triangle < triangle_count; ++triangle)
+        {
+            if (count_misses(indices, triangle, triangle + 1, cache, cache_size) == 3)
+                hard_clusters.push_back(triangle);
+        }
+        if (hard_clusters.empty() || hard_clusters.front() != 0)
+            hard_clusters.insert(hard_clusters.begin(), 0);
+    }
+
+    // soft boundaries: split hard clusters further as long as the split parts stay cache efficient
+    std::vector<size_t> clusters;
+    {
+        fifo_cache cache(vertices.size());
+        for (size_t i = 0; i < hard_clusters.size(); ++i)
+        {
+            const size_t begin = hard_clusters[i];
+            const size_t end = i + 1 < hard_clusters.size() ? hard_clusters[i + 1] : triangle_count;
+
+            cache.reset();
+            const size_t cluster_misses = count_misses(indices, begin, end, cache, cache_size);
+            const float cluster_threshold = threshold * static_cast<float>(cluster_misses) /
+                static_cast<float>(end - begin);
+
+            cache.reset();
+            size_t misses = 0;
+            size_t start = begin;
+            clusters.push_back(begin);
+            for (size_t triangle = begin; triangle < end; ++triangle)
+            {
+                misses += count_misses(indices, triangle, triangle + 1, cache, cache_size);
+
+                const float acmr = static_cast<float>(misses) / static_cast<float>(triangle + 1 - start);
+                if (triangle + 1 < end && acmr <= cluster_threshold)
+                {
+                    clusters.push_back(triangle + 1);
+                    start = triangle + 1;
+                    misses = 0;
+                    cache.reset();
+                }
+            }
+        }
+    }
+
+    // sort clusters by how much they face away from the mesh center, outermost first
+    glm::vec3 mesh_centroid(0.0f);
+    for (const auto index : indices)
+        mesh_centroid += vertices[index].position;
+    mesh_centroid /= static_cast<float>(indices.size());
+
+    std::vector<float> sort_keys(clusters.size());
+    for (size_t i = 0; i < clusters.size(); ++i)
+    {
+        const size_t begin = clusters[i];
+        const size_t end = i + 1 < clusters.size() ? clusters[i + 1] : triangle_count;
+
+        glm::vec3 centroid(0.0f);
+        glm::vec3 normal(0.0f);
+        float area = 0.0f;
+        for (size_t triangle = begin; triangle < end; ++triangle)
+        {
+            const auto& a = vertices[indices[triangle * 3 + 0]].position;
+            const auto& b = vertices[indices[triangle * 3 + 1]].position;
+            const auto& c = vertices[indices[triangle * 3 + 2]].position;
+
+            // area weighted, the cross product length is twice the triangle area
+            const glm::vec3 triangle_normal = cross(b - a, c - a);
+            const float triangle_area = length(triangle_normal);
+            centroid += (a + b + c) * (triangle_area / 3.0f);
+            normal += triangle_normal;
+            area += triangle_area;
+        }
+
+        if (area > 0.0f)
+            centroid /= area;
+        const float normal_length = length(normal);
+        if (normal_length > 0.0f)
+            normal /= normal_length;
+
+        sort_keys[i] = dot(centroid - mesh_centroid, normal);
+    }
+
+    std::vector<size_t> order(clusters.size());
+    std::iota(order.begin(), order.end(), 0);
+    std::stable_sort(order.begin(), order.end(), [&sort_keys](const size_t a, const size_t b)
+    {
+        return sort_keys[a] > sort_keys[b];
+    });
+
+    std::vector<unsigned int> result;
+    result.reserve(indices.size());
+    for (const auto cluster : order)
+    {
+        const size_t begin = clusters[cluster];
+        const size_t end = cluster + 1 < clusters.size() ? clusters[cluster + 1] : triangle_count;
+        result.insert(result.end(), indices.begin() + static_cast<std::ptrdiff_t>(begin * 3),
+                      indices.begin() + static_cast<std::ptrdiff_t>(end * 3));
+    }
+
+    indices.swap(result);
+}
+
+void optimize_vertex_fetch(std::vector<vertex>& vertices, std::vector<unsigned int>& indices)
+{
+    std::vector<unsigned int> remap(vertices.size(), invalid_index);
+    std::vector<vertex> result;
+    result.reserve(vertices.size());
+
+    for (auto& index : indices)
+    {
+        if (remap[index] == invalid_index)
+        {
+            remap[index] = static_cast<unsigned int>(result.size());
+            result.push_back(vertices[index]);
+        }
+        index = remap[index];
+    }
+
+    vertices.swap(result);
+}
+
+std::vector<unsigned int> simplify_mesh(const std::vector<vertex>& vertices, const std::vector<unsigned int>& indices,
+                                        const size_t target_index_count, const float target_error,
+                                        float* result_error)
+{
+    std::vector<unsigned int> result = indices;
+    if (result_error)
+        *result_error = 0.0f;
+    if (vertices.empty() || indices.size() <= target_index_count)
+        return result;
+
+    // work in a unit sized space so errors are relative to the mesh extent
+    glm::vec3 bounds_min = vertices[0].position;
+    glm::vec3 bounds_max = vertices[0].position;
+    for (const auto& vertex : vertices)
+    {
+        bounds_min = min(bounds_min, vertex.position);
+        bounds_max = max(bounds_max, vertex.position);
+    }
+    const glm::vec3 extent = bounds_max - bounds_min;
+    const float max_extent = std::max(std::max(extent.x, extent.y), extent.z);
+    const float scale = max_extent > 0.0f ? 1.0f / max_extent : 1.0f;
+
+    std::vector<glm::vec3> positions(vertices.size());
+    for (size_t i = 0; i < vertices.size(); ++i)
+        positions[i] = (vertices[i].position - bounds_min) * scale;
+
+    // vertices sharing a position with another vertex sit on an attribute seam, moving them would tear the mesh
+    std::vector<unsigned int> position_ids(vertices.size());
+    std::vector<unsigned int> position_use_count(vertices.size(), 0);
+    {
+        std::unordered_map<std::uint64_t, std::vector<unsigned int>> buckets;
+        buckets.reserve(vertices.size());
+        for (unsigned int i = 0; i < static_cast<unsigned int>(vertices.size()); ++i)
+        {
+            auto& bucket = buckets[make_position_key(vertices[i].position)];
+            position_ids[i] = i;
+            for (const auto other : bucket)
+            {
+                if (vertices[other].position == vertices[i].position)
+                {
+                    position_ids[i] = other;
+                    break;
+                }
+            }
+            if (position_ids[i] == i)
+                bucket.push_back(i);
+            ++position_use_count[position_ids[i]];
+        }
+    }
+
+    std::vector<bool> locked(vertices.size(), false);
+    for (size_t i = 0; i < vertices.size(); ++i)
+        locked[i] = position_use_count[position_ids[i]] > 1;
+
+    // edges used by a single triangle are open borders
+    {
+        std::unordered_map<std::uint64_t, int> edge_use;
+        edge_use.reserve(indices.size());
+        const auto edge_key = [&position_ids](const unsigned int a, const unsigned int b)
+        {
+            const auto pa = position_ids[a], pb = position_ids[b];
+            return static_cast<std::uint64_t>(std::min(pa, pb)) << 32 | std::max(pa, pb);
+        };
+
+        for (size_t i = 0; i < indices.size(); i += 3)
+            for (int corner = 0; corner < 3; ++corner)
+                ++edge_use[edge_key(indices[i + corner], indices[i + (corner + 1) % 3])];
+
+        for (size_t i = 0; i < indices.size(); i += 3)
+        {
+            for (int corner = 0; corner < 3; ++corner)
+            {
+                const auto a = indices[i + corner], b = indices[i + (corner + 1) % 3];
+                if (edge_use[edge_key(a, b)] == 1)
+                    locked[a] = locked[b] = true;
+            }
+        }
+    }
+
+    std::vector<quadric> quadrics(vertices.size(), quadric{});
+    for (size_t i = 0; i < indices.size(); i += 3)
+    {
+        const auto& a = positions[indices[i + 0]];
+        const auto& b = positions[indices[i + 1]];
+        const auto& c = positions[indices[i + 2]];
+
+        glm::vec3 normal = cross(b - a, c - a);
+        const float area = length(normal);
+        if (area == 0.0f)
+            continue;
+        normal /= area;
+
+        for (int corner = 0; corner < 3; ++corner)
+            quadrics[indices[i + corner]].add_plane(normal, -dot(normal, a), area);
+    }
+
+    const double error_limit = static_cast<double>(target_error) * target_error;
+    double max_error = 0.0;
+
+    std::vector<collapse> collapses;
+    std::vector<unsigned int> remap(vertices.size());
+    std::vector<bool> touched(vertices.size());
+
+    while (result.size() > target_index_count)
+    {
+        const triangle_adjacency adjacency(result, vertices.size());
+
+        collapses.clear();
+        for (size_t i = 0; i < result.size(); i += 3)
+        {
+            for (int corner = 0; corner < 3; ++corner)
+            {
+                const auto a = result[i + corner], b = result[i + (corner + 1) % 3];
+                quadric combined = quadrics[a];
+                combined.add(quadrics[b]);
+                if (!locked[a])
+                    collapses.push_back({a, b, combined.evaluate(positions[b])});
+                if (!locked[b])
+                    collapses.push_back({b, a, combined.evaluate(positions[a])});
+            }
+        }
+
+        std::sort(collapses.begin(), collapses.end(), [](const collapse& x, const collapse& y)
+        {
+            return x.error < y.error;
+        });
+
+        std::iota(remap.begin(), remap.end(), 0);
+        std::fill(touched.begin(), touched.end(), false);
+
+        // every collapse removes about two triangles, don't overshoot the target by much in one pass
+        const size_t triangles_to_remove = (result.size() - target_index_count) / 3;
+        size_t collapse_budget = std::max<size_t>(triangles_to_remove / 2, 1);
+        size_t collapsed = 0;
+
+        for (const auto& candidate : collapses)
+        {
+            if (candidate.error > error_limit || collapsed >= collapse_budget)
+                break;
+            if (touched[candidate.from] || touched[candidate.to])
+                continue;
+
+            bool valid = true;
+            const auto begin = adjacency.offsets[candidate.from];
+            const auto end = adjacency.offsets[candidate.from + 1];
+            for (auto t = begin; t < end && valid; ++t)
+            {
+                const auto triangle = adjacency.triangles[t] * 3;
+                const auto a = result[triangle], b = result[triangle + 1], c = result[triangle + 2];
+                if (a == candidate.to || b == candidate.to || c == candidate.to)
+                    continue;
+
+                const int moved_corner = a == candidate.from ? 0 : b == candidate.from ? 1 : 2;
+                valid = keeps_orientation(positions[a], positions[b], positions[c], moved_corner,
+                                          positions[candidate.to]);
+            }
+
+            if (!valid)
+                continue;
+
+            // keep the neighbourhood stable for the rest of the pass so the orientation checks stay valid
+            for (auto t = begin; t < end; ++t)
+            {
+                const auto triangle = adjacency.triangles[t] * 3;
+                touched[result[triangle]] = touched[result[triangle + 1]] = touched[result[triangle + 2]] = true;
+            }
+
+            remap[candidate.from] = candidate.to;
+            quadrics[candidate.to].add(quadrics[candidate.from]);
+            max_error = std::max(max_error, candidate.error);
+            ++collapsed;
+        }
+
+        if (collapsed == 0)
+            break;
+
+        size_t write = 0;
+        for (size_t i = 0; i < result.size(); i += 3)
+        {
+            const auto a = remap[result[i]], b = remap[result[i + 1]], c = remap[result[i + 2]];
+            if (a == b || b == c || a == c)
+                continue;
+
+            result[write++] = a;
+            result[write++] = b;
+            result[write++] = c;
+        }
+        result.resize(write);
+    }
+
+    if (result_error)
+        *result_error = static_cast<float>(std::sqrt(max_error));
+    return result;
+}
+
+void compute_bounding_sphere(const std::vector<vertex>& vertices, glm::vec3& center, float& radius)
+{
+    center = glm::vec3(0.0f);
+    radius = 0.0f;
+    if (vertices.empty())
+        return;
+
+    glm::vec3 bounds_min = vertices[0].position;
+    glm::vec3 bounds_max = vertices[0].position;
+    for (const auto& vertex : vertices)
+    {
+        bounds_min = min(bounds_min, vertex.position);
+        bounds_max = max(bounds_max, vertex.position);
+    }
+
+    center = (bounds_min + bounds_max) * 0.5f;
+    for (const auto& vertex : vertices)
+        radius = std::max(radius, length(vertex.position - center));
+}
+
+namespace
+{
+    // cones wider than this (dot product with the axis) can only be culled from a sliver of directions
+    constexpr float min_cone_spread = 0.1f;
+
+    meshlet make_meshlet(const std::vector<vertex>& vertices, const std::vector<unsigned int>& indices,
+                         const size_t index_offset, const size_t index_count)
+    {
+        meshlet result{};
+        result.index_offset = static_cast<std::uint32_t>(index_offset);
+        result.index_count = static_cast<std::uint32_t>(index_count);
+
+        glm::vec3 bounds_min = vertices[indices[index_offset]].position;
+        glm::vec3 bounds_max = bounds_min;
+        glm::vec3 normal_sum(0.0f);
+        for (size_t i = index_offset; i < index_offset + index_count; i += 3)
+        {
+            const glm::vec3& a = vertices[indices[i]].position;
+            const glm::vec3& b = vertices[indices[i + 1]].position;
+            const glm::vec3& c = vertices[indices[i + 2]].position;
+            bounds_min = min(bounds_min, min(a, min(b, c)));
+            bounds_max = max(bounds_max, max(a, max(b, c)));
+
+            const glm::vec3 normal = cross(b - a, c - a);
+            const float area = length(normal);
+            if (area > 0.0f)
+                normal_sum += normal / area;
+        }
+
+        result.center = (bounds_min + bounds_max) * 0.5f;
+        for (size_t i = index_offset; i < index_offset + index_count; ++i)
+            result.radius = std::max(result.radius, length(vertices[indices[i]].position - result.center));
+
+        result.cone_axis = glm::vec3(0.0f, 0.0f, 1.0f);
+        result.cone_cutoff = 1.0f;
+        const float normal_length = length(normal_sum);
+        if (normal_length <= 0.0f)
+            return result;
+
+        const glm::vec3 axis = normal_sum / normal_length;
+        float min_dot = 1.0f;
+        for (size_t i = index_offset; i < index_offset + index_count; i += 3)
+        {
+            const glm::vec3& a = vertices[indices[i]].position;
+            const glm::vec3 normal = cross(vertices[indices[i + 1]].position - a, vertices[indices[i + 2]].position - a);
+            const float area = length(normal);
+            if (area > 0.0f)
+                min_dot = std::min(min_dot, dot(axis, normal) / area);
+        }
+
+        result.cone_axis = axis;
+        if (min_dot > min_cone_spread)
+            result.cone_cutoff = std::sqrt(1.0f - min_dot * min_dot);
+        return result;
+    }
+}
+
+std::vector<meshlet> build_meshlets(const std::vector<vertex>& vertices, const std::vector<unsigned int>& indices,
+                                    const size_t index_offset, const size_t index_count, const size_t max_vertices,
+                                    const size_t max_triangles)
+{
+    std::vector<meshlet> meshlets;
+
+    // meshlet each vertex was last added to, so membership is a single lookup
+    std::vector<size_t> vertex_meshlet(vertices.size(), ~size_t(0));
+    size_t meshlet_start = index_offset;
+    size_t meshlet_vertex_count = 0;
+
+    const size_t index_end = index_offset + index_count / 3 * 3;
+    for (size_t i = index_offset; i < index_end; i += 3)
+    {
+        size_t new_vertex_count = 0;
+        for (size_t corner = 0; corner < 3; ++corner)
+        {
+            if (vertex_meshlet[indices[i + corner]] != meshlets.size())
+                ++new_vertex_count;
+        }
+
+        const size_t triangle_count = (i - meshlet_start) / 3;
+        if (meshlet_vertex_count + new_vertex_count > max_vertices || triangle_count + 1 > max_triangles)
+        {
+            meshlets.push_back(make_meshlet(vertices, indices, meshlet_start, i - meshlet_start));
+            meshlet_start = i;
+            meshlet_vertex_count = 0;
+        }
+
+        for (size_t corner = 0; corner < 3; ++corner)
+        {
+            auto& owner = vertex_meshlet[indices[i + corner]];
+            if (owner != meshlets.size())
+            {
+                owner = meshlets.size();
+                ++meshlet_vertex_count;
+            }
+        }
+    }
+
+    if (meshlet_start < index_end)
+        meshlets.push_back(make_meshlet(vertices, indices, meshlet_start, index_end - meshlet_start));
+
+    return meshlets;
+}
@@ -0,0 +1,55 @@
+﻿#pragma once
+#include <vector>
+
+#include "mesh.h"
+
+// Index and vertex reordering for better use of the GPU's post-transform vertex cache, less overdraw and
+// sequential vertex fetches. All passes keep the triangle set intact, only the order changes.
+
+constexpr unsigned int default_vertex_cache_size = 16;
+constexpr size_t meshlet_max_vertices = 64;
+constexpr size_t meshlet_max_triangles = 124;
+
+struct vertex_cache_statistics
+{
+    // average cache miss ratio: transformed vertices per triangle, 0.5 is the best case for regular grids, 3 the worst
+    float acmr;
+    // average transformed vertex ratio: transformed vertices per unique vertex, 1 is optimal
+    float atvr;
+};
+
+// Merges vertices whose position, normal and texture coordinates all lie within epsilon of each other and rebuilds the
+// index buffer. Returns the number of vertices removed.
+size_t weld_vertices(std::vector<vertex>& vertices, std::vector<unsigned int>& indices, float epsilon);
+
+// simulates a FIFO post-transform cache of the given size
+vertex_cache_statistics analyze_vertex_cache(const std::vector<unsigned int>& indices, size_t vertex_count,
+                                             unsigned int cache_size = default_vertex_cache_size);
+
+// Tipsify (Sander, Nehab, Barczak 2007)
+void optimize_vertex_cache(std::vector<unsigned int>& indices, size_t vertex_count,
+                           unsigned int cache_size = default_vertex_cache_size);
+
+// Reorders clusters of triangles so that outward facing ones are drawn first, to be run after the vertex cache
+// optimization. Clusters are only split where that keeps the ACMR within threshold times the input one.
+void optimize_overdraw(std::vector<unsigned int>& indices, const std::vector<vertex>& vertices, float threshold = 1.05f,
+                       unsigned int cache_size = default_vertex_cache_size);
+
+// orders vertices by first use in the index buffer and drops unreferenced ones
+void optimize_vertex_fetch(std::vector<vertex>& vertices, std::vector<unsigned int>& indices);
+
+// Quadric error edge collapse simplification (Garland, Heckbert 1997) that only collapses vertices onto existing
+// ones, so the result reuses the vertex buffer. Borders and attribute seams are kept in place. Stops at the target
+// index count or when the next collapse would exceed target_error, given relative to the mesh extent.
+std::vector<unsigned int> simplify_mesh(const std::vector<vertex>& vertices, const std::vector<unsigned int>& indices,
+                                        size_t target_index_count, float target_error, float* result_error = nullptr);
+
+// sphere around the AABB center, not minimal but cheap and good enough for culling and LOD selection
+void compute_bounding_sphere(const std::vector<vertex>& vertices, glm::vec3& center, float& radius);
+
+// Splits the index range into meshlets, taking triangles in index order so that the clusters inherit the locality of
+// the vertex cache optimization. The index buffer is left untouched.
+std::vector<meshlet> build_meshlets(const std::vector<vertex>& vertices, const std::vector<unsigned int>& indices,
+                                    size_t index_offset, size_t index_count,
+                                    size_t max_vertices = meshlet_max_vertices,
+                                    size_t max_triangles = meshlet_max_triangles);
@@ -0,0 +1,46 @@
+﻿#include "meshlet.h"
+
+view_frustum view_frustum::from_matrix(const glm::mat4& clip_from_local)
+{
+    // Gribb and Hartmann: each plane is the last row of the matrix plus or minus one of the others
+    const auto row = [&clip_from_local](const int index)
+    {
+        return glm::vec4(clip_from_local[0][index], clip_from_local[1][index], clip_from_local[2][index],
+                         clip_from_local[3][index]);
+    };
+
+    view_frustum result{};
+    for (int axis = 0; axis < 3; ++axis)
+    {
+        result.planes[axis * 2] = row(3) + row(axis);
+        result.planes[axis * 2 + 1] = row(3) - row(axis);
+    }
+
+    for (auto& plane : result.planes)
+        plane /= glm::length(glm::vec3(plane));
+
+    return result;
+}
+
+meshlet_view meshlet_view::from_matrices(const glm::mat4& model_matrix, const glm::mat4& view,
+                                         const glm::mat4& projection)
+{
+    meshlet_view result{};
+    result.frustum = view_frustum::from_matrix(projection * view * model_matrix);
+    result.camera_position = glm::vec3(glm::inverse(view * model_matrix)[3]);
+    return result;
+}
+
+bool is_meshlet_visible(const meshlet& meshlet, const meshlet_view& view)
+{
+    for (const auto& plane : view.frustum.planes)
+    {
+        if (glm::dot(glm::vec3(plane), meshlet.center) + plane.w < -meshlet.radius)
+            return false;
+    }
+
+    // the camera sits behind every triangle plane if it is inside the cone opposite to the normal cone,
+    // widened by the sphere so that it holds for every point of the cluster
+    const glm::vec3 to_center = meshlet.center - view.camera_position;
+    return glm::dot(to_center, meshlet.cone_axis) < meshlet.cone_cutoff * glm::length(to_center) + meshlet.radius;
+}
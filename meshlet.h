@@ -0,0 +1,38 @@
+﻿#pragma once
+#include <cstdint>
+#include <glm/glm.hpp>
+
+// Cluster of triangles from the full detail index buffer, see build_meshlets() in mesh_optimizer.h.
+// The triangles of a meshlet are contiguous, so visible neighbours can be drawn as one range.
+struct meshlet
+{
+    std::uint32_t index_offset;
+    std::uint32_t index_count;
+    glm::vec3 center;
+    float radius;
+    // every triangle normal lies within the cone around cone_axis; cone_cutoff is the sine of its half angle and
+    // 1 when the normals spread too far for the cluster to ever be entirely backfacing
+    glm::vec3 cone_axis;
+    float cone_cutoff;
+};
+
+// view frustum planes, pointing inwards and normalized so distances are in the units of the space they were built in
+struct view_frustum
+{
+    glm::vec4 planes[6];
+
+    // pass projection * view * model to get the planes in model space
+    static view_frustum from_matrix(const glm::mat4& clip_from_local);
+};
+
+// camera as seen from the mesh's model space, everything the meshlet culling needs
+struct meshlet_view
+{
+    view_frustum frustum;
+    glm::vec3 camera_position;
+
+    static meshlet_view from_matrices(const glm::mat4& model_matrix, const glm::mat4& view,
+                                      const glm::mat4& projection);
+};
+
+bool is_meshlet_visible(const meshlet& meshlet, const meshlet_view& view);
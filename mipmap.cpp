@@ -0,0 +1,218 @@
+﻿#include "mipmap.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+
+#include "profiler.h"
+#include "thread_pool.h"
+
+#if defined(__SSE2__) || defined(_M_X64) || defined(_M_AMD64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define MIPMAP_USE_SSE2
+#include <emmintrin.h>
+#endif
+
+namespace
+{
+    // levels with fewer texels than this are not worth handing to other threads
+    constexpr size_t min_parallel_texel_count = 256 * 256;
+
+    // sRGB transfer function as lookup tables: 8-bit encoded to 16-bit linear and back
+    struct srgb_tables
+    {
+        std::uint16_t to_linear[256];
+        unsigned char from_linear[65536];
+
+        srgb_tables()
+        {
+            for (int i = 0; i < 256; ++i)
+            {
+                const double encoded = i / 255.0;
+                const double linear = encoded <= 0.04045 ? encoded / 12.92 : std::pow((encoded + 0.055) / 1.055, 2.4);
+                to_linear[i] = static_cast<std::uint16_t>(std::lround(linear * 65535.0));
+            }
+
+            for (int i = 0; i < 65536; ++i)
+            {
+                const double linear = i / 65535.0;
+                const double encoded = linear <= 0.0031308 ? linear * 12.92 : 1.055 * std::pow(linear, 1.0 / 2.4) - 0.055;
+                from_linear[i] = static_cast<unsigned char>(std::lround(std::min(std::max(encoded, 0.0), 1.0) * 255.0));
+            }
+        }
+
+        static const srgb_tables& get()
+        {
+            static const srgb_tables tables;
+            return tables;
+        }
+    };
+
+    // Sums of the two source rows, 16 bits per channel. Covers the first 2 * out_width texels.
+    void sum_rows(const unsigned char* row0, const unsigned char* row1, const size_t size, std::uint16_t* sums)
+    {
+        size_t i = 0;
+#ifdef MIPMAP_USE_SSE2
+        const __m128i zero = _mm_setzero_si128();
+        for (; i + 16 <= size; i += 16)
+        {
+            const __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(row0 + i));
+            const __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(row1 + i));
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(sums + i),
+                             _mm_add_epi16(_mm_unpacklo_epi8(a, zero), _mm_unpacklo_epi8(b, zero)));
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(sums + i + 8),
+                             _mm_add_epi16(_mm_unpackhi_epi8(a, zero), _mm_unpackhi_epi8(b, zero)));
+        }
+#endif
+        for (; i < size; ++i)
+            sums[i] = static_cast<std::uint16_t>(row0[i] + row1[i]);
+    }
+
+    // Adds horizontally adjacent texels of the row sums and rounds, giving the 2x2 averages.
+    void average_columns(const std::uint16_t* sums, const int out_width, const int channels, unsigned char* out)
+    {
+        const size_t out_size = static_cast<size_t>(out_width) * channels;
+        size_t o = 0;
+#ifdef MIPMAP_USE_SSE2
+        const __m128i rounding = _mm_set1_epi16(2);
+        const auto load = [sums](const size_t index)
+        {
+            return _mm_loadu_si128(reinterpret_cast<const __m128i*>(sums + index));
+        };
+
+        if (channels == 4)
+        {
+            // every register holds two texels, swapping the 64-bit halves lines up the neighbours
+            for (; o + 16 <= out_size; o += 16)
+            {
+                const __m128i s0 = load(o * 2), s1 = load(o * 2 + 8), s2 = load(o * 2 + 16), s3 = load(o * 2 + 24);
+                const __m128i t0 = _mm_add_epi16(_mm_unpacklo_epi64(s0, s1), _mm_unpackhi_epi64(s0, s1));
+                const __m128i t1 = _mm_add_epi16(_mm_unpacklo_epi64(s2, s3), _mm_unpackhi_epi64(s2, s3));
+                const __m128i a0 = _mm_srli_epi16(_mm_add_epi16(t0, rounding), 2);
+                const __m128i a1 = _mm_srli_epi16(_mm_add_epi16(t1, rounding), 2);
+                _mm_storeu_si128(reinterpret_cast<__m128i*>(out + o), _mm_packus_epi16(a0, a1));
+            }
+        }
+        else if (channels == 1)
+        {
+            // multiply-add with ones sums neighbouring 16-bit lanes into 32-bit ones
+            const __m128i ones = _mm_set1_epi16(1);
+            for (; o + 16 <= out_size; o += 16)
+            {
+                const __m128i p0 = _mm_madd_epi16(load(o * 2), ones), p1 = _mm_madd_epi16(load(o * 2 + 8), ones);
+                const __m128i p2 = _mm_madd_epi16(load(o * 2 + 16), ones), p3 = _mm_madd_epi16(load(o * 2 + 24), ones);
+                const __m128i a0 = _mm_srli_epi16(_mm_add_epi16(_mm_packs_epi32(p0, p1), rounding), 2);
+                const __m128i a1 = _mm_srli_epi16(_mm_add_epi16(_mm_packs_epi32(p2, p3), rounding), 2);
+                _mm_storeu_si128(reinterpret_cast<__m128i*>(out + o), _mm_packus_epi16(a0, a1));
+            }
+        }
+        // three channel texels straddle the register lanes, those go through the scalar loop below
+#endif
+        for (size_t x = o / channels; x < static_cast<size_t>(out_width); ++x)
+        {
+            for (int channel = 0; channel < channels; ++channel)
+            {
+                const size_t tap = x * 2 * channels + channel;
+                out[x * channels + channel] = static_cast<unsigned char>((sums[tap] + sums[tap + channels] + 2) / 4);
+            }
+        }
+    }
+
+    // Scalar 2x2 average, through the sRGB tables for the color channels if given. texel_step is the distance
+    // between the two horizontal taps, 0 when the source is a single texel wide.
+    void average_texels(const unsigned char* row0, const unsigned char* row1, const int out_width, const int channels,
+                        const int texel_step, const srgb_tables* tables, unsigned char* out)
+    {
+        const int color_channels = !tables ? 0 : channels == 2 || channels == 4 ? channels - 1 : channels;
+
+        for (int x = 0; x < out_width; ++x)
+        {
+            const size_t tap = static_cast<size_t>(x) * 2 * channels;
+            for (int channel = 0; channel < channels; ++channel)
+            {
+                const size_t t0 = tap + channel, t1 = tap + channel + texel_step;
+                if (channel < color_channels)
+                {
+                    const std::uint32_t sum = tables->to_linear[row0[t0]] + tables->to_linear[row0[t1]] +
+                        tables->to_linear[row1[t0]] + tables->to_linear[row1[t1]];
+                    out[x * channels + channel] = tables->from_linear[(sum + 2) / 4];
+                }
+                else
+                {
+                    out[x * channels + channel] =
+                        static_cast<unsigned char>((row0[t0] + row0[t1] + row1[t0] + row1[t1] + 2) / 4);
+                }
+            }
+        }
+    }
+
+    void downsample_rows(const unsigned char* source, const int source_width, const int source_height,
+                         mip_level& level, const int channels, const bool srgb, const size_t first_row,
+                         const size_t last_row)
+    {
+        const size_t source_stride = static_cast<size_t>(source_width) * channels;
+        const size_t out_stride = static_cast<size_t>(level.width) * channels;
+        std::vector<std::uint16_t> sums;
+
+        for (size_t y = first_row; y < last_row; ++y)
+        {
+            // a dimension that is already 1 is not halved, both taps then read the same texels
+            const unsigned char* row0 = source + y * 2 * source_stride;
+            const unsigned char* row1 = source_height > 1 ? row0 + source_stride : row0;
+            unsigned char* out = level.pixels.data() + y * out_stride;
+
+            // the table lookups don't vectorize with SSE2, neither does the single column case
+            if (srgb || source_width == 1)
+            {
+                average_texels(row0, row1, level.width, channels, source_width > 1 ? channels : 0,
+                               srgb ? &srgb_tables::get() : nullptr, out);
+                continue;
+            }
+
+            sums.resize(out_stride * 2);
+            sum_rows(row0, row1, sums.size(), sums.data());
+            average_columns(sums.data(), level.width, channels, out);
+        }
+    }
+}
+
+std::vector<mip_level> generate_mip_chain(const unsigned char* pixels, const int width, const int height,
+                                          const int channels, const bool srgb)
+{
+    profile_scope scope("mips");
+    std::vector<mip_level> levels;
+
+    const unsigned char* source = pixels;
+    int source_width = width;
+    int source_height = height;
+    while (source_width > 1 || source_height > 1)
+    {
+        mip_level level;
+        level.width = std::max(source_width / 2, 1);
+        level.height = std::max(source_height / 2, 1);
+        level.pixels.resize(static_cast<size_t>(level.width) * level.height * channels);
+
+        const auto downsample = [&](const size_t first_row, const size_t last_row)
+        {
+            downsample_rows(source, source_width, source_height, level, channels, srgb, first_row, last_row);
+        };
+        if (static_cast<size_t>(level.width) * level.height >= min_parallel_texel_count)
+            thread_pool::shared().parallel_for(static_cast<size_t>(level.height), downsample);
+        else
+            downsample(0, static_cast<size_t>(level.height));
+
+        levels.push_back(std::move(level));
+        source = levels.back().pixels.data();
+        source_width = levels.back().width;
+        source_height = levels.back().height;
+    }
+
+    return levels;
+}
+
+void generate_mipmaps(image& image, const bool srgb)
+{
+    if (!image.is_valid())
+        return;
+
+    image.mip_levels = generate_mip_chain(image.pixels.get(), image.width, image.height, image.channels, srgb);
+}
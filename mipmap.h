@@ -0,0 +1,13 @@
+﻿#pragma once
+#include <vector>
+
+#include "image.h"
+
+// Builds the levels below an 8-bit image down to 1x1, halving each dimension (rounding down, as GL does) and
+// averaging the 2x2 texels underneath every texel. With srgb set, the color channels are averaged in linear light
+// and converted back, alpha is always averaged as is. The source itself is not part of the result.
+// Large levels are split across thread_pool::shared() unless this already runs on one of its workers.
+std::vector<mip_level> generate_mip_chain(const unsigned char* pixels, int width, int height, int channels, bool srgb);
+
+// fills image.mip_levels, does nothing for an invalid image
+void generate_mipmaps(image& image, bool srgb);
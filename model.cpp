@@ -1,59 +1,531 @@
 ﻿#include "model.h"
 #include "mesh.h"
 
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <fstream>
+#include <limits>
+#include <sstream>
+#include <unordered_set>
+
 #include <assimp/Importer.hpp>
+#include <assimp/IOStream.hpp>
+#include <assimp/IOSystem.hpp>
 #include <assimp/scene.h>
 #include <assimp/postprocess.h>
+#include <glm/gtc/type_ptr.hpp>
+
+#include "asset_io.h"
+#include "dds_texture.h"
+#include "hash.h"
+#include "mesh_cache.h"
+#include "mesh_optimizer.h"
+#include "mipmap.h"
+#include "profiler.h"
+#include "texture_array.h"
+#include "texture_compression.h"
+#include "texture_registry.h"
+#include "thread_pool.h"
+#include "vertex_compression.h"
+
+namespace
+{
+    std::string get_package_texture_name(const std::string& texture_path)
+    {
+        return "texture/" + texture_path;
+    }
+
+    // bytes the image and its levels take as plain 8-bit texels
+    size_t get_uncompressed_size(const image& image)
+    {
+        if (!image.is_valid())
+            return 0;
+
+        size_t size = static_cast<size_t>(image.width) * image.height * image.channels;
+        for (const auto& level : image.mip_levels)
+            size += level.pixels.size();
+        return size;
+    }
+
+    // diffuse maps hold sRGB-encoded color and are filtered in linear light, the other maps are data
+    bool is_color_texture(const std::string& type)
+    {
+        return type == "texture_diffuse";
+    }
+
+    // Assimp file access through asset_io: the importer reads from the shared mapping, prefetched or not, instead
+    // of opening the files again with stdio.
+    class mapped_io_stream final : public Assimp::IOStream
+    {
+    public:
+        explicit mapped_io_stream(std::shared_ptr<const mapped_file> file) : file_(std::move(file)), position_(0)
+        {
+        }
+
+        size_t Read(void* buffer, const size_t size, const size_t count) override
+        {
+            if (size == 0)
+                return 0;
+
+            const size_t read_count = std::min(count, (file_->size() - position_) / size);
+            std::memcpy(buffer, file_->data() + position_, read_count * size);
+            position_ += read_count * size;
+            asset_io::instance().add_bytes_copied(read_count * size);
+            return read_count;
+        }
 
-#include "stb_image.h"
+        size_t Write(const void*, size_t, size_t) override
+        {
+            return 0;
+        }
+
+        aiReturn Seek(const size_t offset, const aiOrigin origin) override
+        {
+            size_t position = offset;
+            if (origin == aiOrigin_CUR)
+                position += position_;
+            else if (origin == aiOrigin_END)
+                position = file_->size() - offset;
+
+            if (position > file_->size())
+                return aiReturn_FAILURE;
+            position_ = position;
+            return aiReturn_SUCCESS;
+        }
+
+        size_t Tell() const override
+        {
+            return position_;
+        }
+
+        size_t FileSize() const override
+        {
+            return file_->size();
+        }
+
+        void Flush() override
+        {
+        }
+
+    private:
+        std::shared_ptr<const mapped_file> file_;
+        size_t position_;
+    };
+
+    class mapped_io_system final : public Assimp::IOSystem
+    {
+    public:
+        bool Exists(const char* path) const override
+        {
+            return asset_io::instance().exists(path);
+        }
+
+        char getOsSeparator() const override
+        {
+            return '/';
+        }
+
+        Assimp::IOStream* Open(const char* path, const char* mode) override
+        {
+            // read only, Assimp never writes while importing
+            if (mode && (std::strchr(mode, 'w') || std::strchr(mode, 'a')))
+                return nullptr;
+
+            auto file = asset_io::instance().open(path);
+            return file->is_open() ? new mapped_io_stream(std::move(file)) : nullptr;
+        }
+
+        void Close(Assimp::IOStream* stream) override
+        {
+            delete stream;
+        }
+    };
+
+    // material libraries an OBJ file pulls in, they are inputs of the cooked package as well
+    std::vector<std::string> find_material_libraries(const std::string& path)
+    {
+        std::vector<std::string> libraries;
+        if (path.size() < 4 || path.compare(path.size() - 4, 4, ".obj") != 0)
+            return libraries;
+
+        const auto directory = path.substr(0, path.find_last_of('/'));
+        std::ifstream stream(path);
+        std::string line;
+        while (std::getline(stream, line))
+        {
+            const std::string keyword = "mtllib ";
+            if (line.compare(0, keyword.size(), keyword) != 0)
+                continue;
+
+            std::istringstream names(line.substr(keyword.size()));
+            std::string name;
+            while (names >> name)
+                libraries.push_back(directory + '/' + name);
+        }
+
+        return libraries;
+    }
+
+    // the files an import of the model reads, the model file first; they make up the mesh cache key
+    std::vector<std::string> get_import_inputs(const std::string& path)
+    {
+        auto inputs = find_material_libraries(path);
+        inputs.insert(inputs.begin(), path);
+        return inputs;
+    }
+
+    // positions by the full transform, normals by its inverse transpose so non-uniform scales keep them perpendicular
+    void transform_vertices(std::vector<vertex>& vertices, const aiMatrix4x4& transform)
+    {
+        // Assimp matrices are row-major, glm ones column-major
+        const glm::mat4 matrix = glm::transpose(glm::make_mat4(&transform.a1));
+        const glm::mat3 normal_matrix = glm::transpose(glm::inverse(glm::mat3(matrix)));
+        for (auto& vertex : vertices)
+        {
+            vertex.position = glm::vec3(matrix * glm::vec4(vertex.position, 1.0f));
+            const glm::vec3 normal = normal_matrix * vertex.normal;
+            const float length = glm::length(normal);
+            vertex.normal = length > 0.0f ? normal / length : vertex.normal;
+        }
+    }
+
+    const char* get_retention_name(const mesh_retention retention)
+    {
+        switch (retention)
+        {
+        case mesh_retention::discard:
+            return "retained, discard";
+        case mesh_retention::positions:
+            return "retained, positions";
+        case mesh_retention::all:
+            return "retained, all";
+        }
+        return "retained";
+    }
+}
+
+std::uint64_t model_params::hash() const
+{
+    std::uint64_t hash = hash_value(texture_clamp);
+    hash = hash_value(texture_flip, hash);
+    hash = hash_value(batch_meshes, hash);
+    hash = hash_value(weld_vertices, hash);
+    hash = hash_value(weld_epsilon, hash);
+    hash = hash_value(optimize_meshes, hash);
+    hash = hash_value(compact_vertices, hash);
+    hash = hash_value(static_cast<std::uint64_t>(lod_count), hash);
+    hash = hash_value(lod_max_error, hash);
+    hash = hash_value(build_meshlets, hash);
+    hash = hash_value(compress_textures, hash);
+    return hash;
+}
 
 unsigned int texture_from_file(const char* path, const std::string& directory, const model_params& model_params,
                                bool gamma)
 {
     auto filename = std::string(path);
     filename = directory + '/' + filename;
+    profile_scope scope("load", filename);
 
+    if (is_dds_file(filename))
+        return upload_texture(dds_texture(filename).get_texture(), model_params, gamma);
+
+    image image = decode_image(filename, model_params.texture_flip);
+    generate_mipmaps(image, gamma);
+    return upload_texture(image, model_params, gamma);
+}
+
+unsigned int upload_texture(const image& image, const model_params& model_params, bool gamma)
+{
     unsigned int texture_id;
     glGenTextures(1, &texture_id);
 
-    int width, height, nr_components;
-    unsigned char* data = stbi_load(filename.c_str(), &width, &height, &nr_components, 0);
-    if (data)
+    if (image.is_valid())
     {
         GLint format = 0;
-        if (nr_components == 1)
+        if (image.channels == 1)
             format = GL_RED;
-        else if (nr_components == 3)
+        else if (image.channels == 2)
+            format = GL_RG;
+        else if (image.channels == 3)
             format = GL_RGB;
-        else if (nr_components == 4)
+        else if (image.channels == 4)
             format = GL_RGBA;
 
+        // images decoded without their chain get it here, on this thread, instead of through glGenerateMipmap
+        std::vector<mip_level> generated;
+        if (image.mip_levels.empty())
+            generated = generate_mip_chain(image.pixels.get(), image.width, image.height, image.channels, gamma);
+        const auto& mip_levels = image.mip_levels.empty() ? generated : image.mip_levels;
+
         glBindTexture(GL_TEXTURE_2D, texture_id);
-        glTexImage2D(GL_TEXTURE_2D, 0, format, width, height, 0, format, GL_UNSIGNED_BYTE, data);
-        glGenerateMipmap(GL_TEXTURE_2D);
+        // levels are tightly packed, small RGB levels have rows that are not a multiple of 4 bytes
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+        glTexImage2D(GL_TEXTURE_2D, 0, format, image.width, image.height, 0, format, GL_UNSIGNED_BYTE,
+                     image.pixels.get());
+        for (size_t level = 0; level < mip_levels.size(); ++level)
+        {
+            const auto& data = mip_levels[level];
+            glTexImage2D(GL_TEXTURE_2D, static_cast<GLint>(level + 1), format, data.width, data.height, 0, format,
+                         GL_UNSIGNED_BYTE, data.pixels.data());
+        }
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, static_cast<GLint>(mip_levels.size()));
 
         const auto wrap_mode = model_params.texture_clamp ? GL_CLAMP_TO_EDGE : GL_REPEAT;
         glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, wrap_mode);
         glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, wrap_mode);
         glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
         glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    }
+
+    return texture_id;
+}
 
-        stbi_image_free(data);
+unsigned int upload_texture(const cooked_texture& texture, const model_params& model_params, bool gamma)
+{
+    if (texture.format != block_format::none && !is_block_format_supported(texture.format))
+    {
+        // the driver can't sample the blocks, upload them as plain texels instead
+        const auto decompressed = decompress_texture(texture);
+        if (!decompressed.is_valid())
+            std::cout << "ERROR::TEXTURE::UNSUPPORTED_BLOCK_FORMAT " << static_cast<int>(texture.format) << std::endl;
+        return upload_texture(decompressed, model_params, gamma);
     }
-    else
+
+    unsigned int texture_id;
+    glGenTextures(1, &texture_id);
+
+    if (texture.is_valid())
     {
-        std::cout << "Texture failed to load at path: " << filename << " (" << stbi_failure_reason() << ")" <<
-            std::endl;
-        stbi_image_free(data);
+        GLint format = 0;
+        if (texture.channels == 1)
+            format = GL_RED;
+        else if (texture.channels == 2)
+            format = GL_RG;
+        else if (texture.channels == 3)
+            format = GL_RGB;
+        else if (texture.channels == 4)
+            format = GL_RGBA;
+
+        glBindTexture(GL_TEXTURE_2D, texture_id);
+        // cooked levels are tightly packed, small RGB levels have rows that are not a multiple of 4 bytes
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+        for (size_t level = 0; level < texture.levels.size(); ++level)
+        {
+            const auto& data = texture.levels[level];
+            if (texture.format != block_format::none)
+            {
+                glCompressedTexImage2D(GL_TEXTURE_2D, static_cast<GLint>(level),
+                                       get_gl_internal_format(texture.format), data.width, data.height, 0,
+                                       static_cast<GLsizei>(data.size), data.pixels);
+            }
+            else
+            {
+                glTexImage2D(GL_TEXTURE_2D, static_cast<GLint>(level), format, data.width, data.height, 0, format,
+                             GL_UNSIGNED_BYTE, data.pixels);
+            }
+        }
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, static_cast<GLint>(texture.levels.size() - 1));
+
+        const auto wrap_mode = model_params.texture_clamp ? GL_CLAMP_TO_EDGE : GL_REPEAT;
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, wrap_mode);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, wrap_mode);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER,
+                        texture.levels.size() > 1 ? GL_LINEAR_MIPMAP_LINEAR : GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
     }
 
     return texture_id;
 }
 
 model::model(const std::string& path, const model_params& params):
-    params_(params)
+    model(path, params, std::future<import_result>())
 {
-    load_model(path);
+    profile_scope scope("load", path_);
+    imported_ = import_model(path_, params_);
+
+    for (size_t i = 0; i < imported_.get_mesh_count(); ++i)
+        decode_textures_async(imported_.get_textures(i));
+    textures_requested_ = true;
+
+    for (size_t i = 0; i < imported_.get_mesh_count(); ++i)
+        upload_mesh(i);
+
+    finish_loading();
+}
+
+model::model(std::string path, const model_params& params, std::future<import_result> pending_import):
+    path_(std::move(path)),
+    params_(params),
+    pending_import_(std::move(pending_import)),
+    meshes_uploaded_(0),
+    textures_requested_(false),
+    packing_failed_(false),
+    ready_(false),
+    load_start_time_(std::chrono::steady_clock::now()),
+    bounds_center_(0.0f),
+    bounds_radius_(0.0f),
+    lod_count_(1)
+{
+    directory_ = path_.substr(0, path_.find_last_of('/'));
+}
+
+model::~model()
+{
+    auto& registry = texture_registry::instance();
+    for (const auto texture_id : textures_acquired_)
+        registry.release(texture_id);
+    for (const auto& packed : packed_acquired_)
+        texture_array_registry::instance().release(packed);
+}
+
+model model::load_async(const std::string& path, const model_params& params)
+{
+    auto pending_import = thread_pool::shared().submit([path, params]
+    {
+        return import_model(path, params);
+    });
+    return {path, params, std::move(pending_import)};
+}
+
+std::vector<std::string> model::get_input_files(const std::string& path, const model_params& params)
+{
+    if (params.use_packages)
+    {
+        auto package_path = asset_package::get_path(path);
+        if (asset_io::instance().exists(package_path))
+        {
+            // the sources it was cooked from are hashed to check it is current
+            auto files = asset_package(package_path).get_inputs();
+            files.insert(files.begin(), std::move(package_path));
+            return files;
+        }
+    }
+
+    // the mesh cache file is named after the contents of these, it is only known once they have been read
+    return get_import_inputs(path);
+}
+
+bool model::cook(const std::string& path, const model_params& params)
+{
+    const auto package_path = asset_package::get_path(path);
+    if (asset_package::is_up_to_date(package_path, params.hash()))
+    {
+        std::cout << "COOK::UP_TO_DATE " << path << std::endl;
+        return true;
+    }
+
+    const auto start_time = std::chrono::steady_clock::now();
+
+    auto import_params = params;
+    import_params.use_packages = false;
+    import_params.use_mesh_cache = false;
+    const auto imported = import_model(path, import_params);
+    if (imported.meshes.empty())
+        return false;
+
+    asset_package_writer writer;
+    writer.add_input(path);
+    for (const auto& material_library : find_material_libraries(path))
+        writer.add_input(material_library);
+    writer.add_meshes(imported.meshes, params.hash());
+
+    // decode, and optionally compress, every referenced texture once, in parallel
+    const auto directory = path.substr(0, path.find_last_of('/'));
+    std::unordered_set<std::string> texture_paths;
+    std::vector<std::pair<std::string, std::future<std::vector<unsigned char>>>> cooked_textures;
+    std::atomic<size_t> source_bytes{0}, cooked_bytes{0};
+    for (const auto& mesh_data : imported.meshes)
+    {
+        for (const auto& reference : mesh_data.textures)
+        {
+            // DDS files are already in their final form and are loaded straight from disk
+            if (!texture_paths.insert(reference.path).second || is_dds_file(reference.path))
+                continue;
+
+            const auto filename = directory + '/' + reference.path;
+            const bool flip = params.texture_flip;
+            const bool srgb = is_color_texture(reference.type);
+            const bool compress = params.compress_textures;
+            writer.add_input(filename);
+            cooked_textures.emplace_back(reference.path, thread_pool::shared().submit(
+                [filename, flip, srgb, compress, &source_bytes, &cooked_bytes]
+                {
+                    profile_scope scope("load", filename);
+                    auto image = decode_image(filename, flip);
+                    generate_mipmaps(image, srgb);
+                    auto entry = compress
+                        ? asset_package_writer::make_texture_entry(compress_image(image, choose_block_format(image)))
+                        : asset_package_writer::make_texture_entry(image);
+                    source_bytes += get_uncompressed_size(image);
+                    cooked_bytes += entry.size();
+                    return entry;
+                }));
+        }
+    }
+
+    for (auto& [texture_path, pending] : cooked_textures)
+    {
+        auto entry = pending.get();
+        if (!entry.empty())
+            writer.add_entry(get_package_texture_name(texture_path), std::move(entry));
+    }
+
+    if (!writer.write(package_path, params.hash()))
+        return false;
+
+    const std::chrono::duration<double, std::milli> cook_time = std::chrono::steady_clock::now() - start_time;
+    std::cout << "COOK::COOKED " << path << " -> " << package_path << " in " << cook_time.count() <<
+        " ms, textures " << source_bytes / 1024 << " KiB -> " << cooked_bytes / 1024 << " KiB" << std::endl;
+    return true;
+}
+
+bool model::is_ready() const
+{
+    return ready_;
+}
+
+void model::update_loading(const float time_budget_ms)
+{
+    if (ready_)
+        return;
+
+    const auto start_time = std::chrono::steady_clock::now();
+    const auto budget = std::chrono::duration<float, std::milli>(time_budget_ms);
+
+    if (pending_import_.valid())
+    {
+        if (pending_import_.wait_for(std::chrono::seconds(0)) != std::future_status::ready)
+            return;
+        imported_ = pending_import_.get();
+    }
+
+    if (!textures_requested_)
+    {
+        for (size_t i = 0; i < imported_.get_mesh_count(); ++i)
+            decode_textures_async(imported_.get_textures(i));
+        textures_requested_ = true;
+    }
+
+    // upload at least one mesh per call so that loading always makes progress, but never wait for a decode
+    while (meshes_uploaded_ < imported_.get_mesh_count())
+    {
+        if (!are_textures_decoded(imported_.get_textures(meshes_uploaded_)))
+            return;
+
+        upload_mesh(meshes_uploaded_);
+
+        if (std::chrono::steady_clock::now() - start_time > budget)
+            break;
+    }
+
+    if (meshes_uploaded_ == imported_.get_mesh_count())
+        finish_loading();
 }
 
 void model::draw(const shader& shader) const
@@ -62,48 +534,415 @@ void model::draw(const shader& shader) const
     draw(shader, extra_textures);
 }
 
-void model::draw(const shader& shader, const std::vector<extra_texture>& extra_textures) const
+void model::draw(const shader& shader, const std::vector<extra_texture>& extra_textures, const size_t lod) const
 {
+    if (!ready_)
+        return;
+
+    for (auto& mesh : meshes_)
+    {
+        mesh.draw(shader, extra_textures, GL_TRIANGLES, lod);
+    }
+}
+
+void model::draw(const shader& shader, const std::vector<extra_texture>& extra_textures, const glm::mat4& model_matrix,
+                 const glm::mat4& view, const glm::mat4& projection, size_t& lod) const
+{
+    if (!ready_)
+        return;
+
+    lod = select_lod(model_matrix, view, projection, lod);
+    if (lod != 0)
+    {
+        draw(shader, extra_textures, lod);
+        return;
+    }
+
+    const auto culling_view = meshlet_view::from_matrices(model_matrix, view, projection);
     for (auto& mesh : meshes_)
     {
-        mesh.draw(shader, extra_textures);
+        mesh.draw(shader, extra_textures, culling_view);
     }
 }
 
-void model::load_model(const std::string& path)
+size_t model::get_lod_count() const
 {
+    return lod_count_;
+}
+
+bool model::has_texture_arrays() const
+{
+    return !packed_acquired_.empty() && textures_acquired_.empty();
+}
+
+size_t model::get_resident_cpu_bytes() const
+{
+    size_t bytes = 0;
+    for (const auto& mesh : meshes_)
+        bytes += mesh.get_resident_cpu_bytes();
+    // imported meshes not uploaded yet, while an asynchronous load is still running
+    for (const auto& mesh_data : imported_.meshes)
+    {
+        bytes += mesh_data.vertices.capacity() * sizeof(vertex) + mesh_data.indices.capacity() * sizeof(unsigned int) +
+            mesh_data.compact_vertices.capacity() * sizeof(compact_vertex) +
+            mesh_data.short_indices.capacity() * sizeof(std::uint16_t);
+    }
+    return bytes;
+}
+
+size_t model::select_lod(const glm::mat4& model_matrix, const glm::mat4& view, const glm::mat4& projection,
+                         const size_t current_lod) const
+{
+    if (lod_count_ <= 1)
+        return 0;
+
+    const glm::vec4 view_center = view * model_matrix * glm::vec4(bounds_center_, 1.0f);
+    const float scale = std::max({
+        glm::length(glm::vec3(model_matrix[0])), glm::length(glm::vec3(model_matrix[1])),
+        glm::length(glm::vec3(model_matrix[2]))
+    });
+    const float radius = bounds_radius_ * scale;
+    const float distance = -view_center.z;
+    if (distance <= radius)
+        return 0;
+
+    // fraction of the viewport height covered by the sphere
+    const float screen_size = radius * projection[1][1] / distance;
+
+    const auto lod_for_size = [this](const float size)
+    {
+        size_t lod = 0;
+        for (float threshold = lod_screen_size; lod + 1 < lod_count_ && size < threshold; threshold *= 0.5f)
+            ++lod;
+        return lod;
+    };
+
+    const size_t coarser_lod = lod_for_size(screen_size * (1.0f + lod_hysteresis));
+    if (coarser_lod > current_lod)
+        return coarser_lod;
+    const size_t finer_lod = lod_for_size(screen_size * (1.0f - lod_hysteresis));
+    if (finer_lod < current_lod)
+        return finer_lod;
+    return std::min(current_lod, lod_count_ - 1);
+}
+
+size_t model::import_result::get_mesh_count() const
+{
+    return mapped_meshes ? mapped_meshes->size() : meshes.size();
+}
+
+const std::vector<texture_reference>& model::import_result::get_textures(const size_t mesh_index) const
+{
+    return mapped_meshes ? (*mapped_meshes)[mesh_index].textures : meshes[mesh_index].textures;
+}
+
+model::import_result model::import_model(const std::string& path, const model_params& params)
+{
+    profile_scope scope("import", path);
+    import_result result;
+
+    if (params.use_packages)
+    {
+        auto package = std::make_unique<asset_package>(asset_package::get_path(path));
+        const bool params_match = package->is_valid() && package->has_meshes() &&
+            package->get_params_hash() == params.hash();
+        // the sources are only hashed, which is far cheaper than importing them
+        if (params_match && package->are_inputs_unchanged())
+        {
+            result.mapped_meshes = &package->get_meshes();
+            result.package = std::move(package);
+            return result;
+        }
+        if (params_match)
+            std::cout << "MODEL::PACKAGE_STALE " << path << " (sources changed since cooking, run the cooker)" <<
+                std::endl;
+        else if (package->is_valid())
+            std::cout << "MODEL::PACKAGE_IGNORED " << path << " (cooked with different model_params)" << std::endl;
+    }
+
+    const std::uint64_t cache_key =
+        params.use_mesh_cache ? mesh_cache::make_key(get_import_inputs(path), params.hash()) : 0;
+    if (cache_key != 0)
+    {
+        result.cache = std::make_unique<mesh_cache>(cache_key);
+        if (result.cache->is_valid())
+        {
+            result.mapped_meshes = &result.cache->get_meshes();
+            return result;
+        }
+        result.cache.reset();
+    }
+
     Assimp::Importer importer;
+    // the importer owns and deletes the handler
+    importer.SetIOHandler(new mapped_io_system);
     const aiScene* scene = importer.ReadFile(path, aiProcess_Triangulate | aiProcess_FlipUVs);
 
     if (!scene || scene->mFlags & AI_SCENE_FLAGS_INCOMPLETE || !scene->mRootNode)
     {
         std::cout << "ERROR::ASSIMP::" << importer.GetErrorString() << std::endl;
-        return;
+        return result;
     }
 
-    directory_ = path.substr(0, path.find_last_of('/'));
-    process_node(scene->mRootNode, scene);
+    if (params.batch_meshes)
+    {
+        std::unordered_map<unsigned int, size_t> mesh_by_material;
+        process_node_batched(scene->mRootNode, scene, aiMatrix4x4(), mesh_by_material, result.meshes);
+        std::cout << "MODEL::BATCHED " << path << " " << scene->mNumMeshes << " meshes -> " << result.meshes.size() <<
+            std::endl;
+    }
+    else
+    {
+        process_node(scene->mRootNode, scene, result.meshes);
+    }
+
+    for (auto& mesh_data : result.meshes)
+        compute_bounding_sphere(mesh_data.vertices, mesh_data.bounds_center, mesh_data.bounds_radius);
+
+    if (params.weld_vertices)
+    {
+        for (size_t i = 0; i < result.meshes.size(); ++i)
+            weld_mesh(result.meshes[i], params.weld_epsilon, path, i);
+    }
+
+    if (params.optimize_meshes)
+    {
+        for (size_t i = 0; i < result.meshes.size(); ++i)
+            optimize_mesh(result.meshes[i], path, i);
+    }
+
+    if (params.lod_count > 1)
+    {
+        for (size_t i = 0; i < result.meshes.size(); ++i)
+            build_lods(result.meshes[i], params, path, i);
+    }
+
+    if (params.build_meshlets)
+    {
+        for (size_t i = 0; i < result.meshes.size(); ++i)
+            cluster_mesh(result.meshes[i], path, i);
+    }
+
+    if (params.compact_vertices)
+    {
+        for (size_t i = 0; i < result.meshes.size(); ++i)
+            compress_mesh(result.meshes[i], path, i);
+    }
+
+    if (cache_key != 0)
+        mesh_cache::store(cache_key, result.meshes);
+
+    return result;
+}
+
+void model::weld_mesh(mesh_data& mesh_data, const float epsilon, const std::string& path, const size_t mesh_index)
+{
+    const size_t vertex_count_before = mesh_data.vertices.size();
+    weld_vertices(mesh_data.vertices, mesh_data.indices, epsilon);
+    const size_t vertex_count_after = mesh_data.vertices.size();
+
+    const size_t index_bytes = mesh_data.indices.size() * sizeof(unsigned int);
+    std::ostringstream message;
+    message << "MESH_WELD::" << path << " mesh " << mesh_index << ": vertices " << vertex_count_before << " -> " <<
+        vertex_count_after << ", bytes " << vertex_count_before * sizeof(vertex) + index_bytes << " -> " <<
+        vertex_count_after * sizeof(vertex) + index_bytes << '\n';
+    std::cout << message.str() << std::flush;
+}
+
+void model::optimize_mesh(mesh_data& mesh_data, const std::string& path, const size_t mesh_index)
+{
+    auto& vertices = mesh_data.vertices;
+    auto& indices = mesh_data.indices;
+    const auto before = analyze_vertex_cache(indices, vertices.size());
+
+    optimize_vertex_cache(indices, vertices.size());
+    optimize_overdraw(indices, vertices);
+    optimize_vertex_fetch(vertices, indices);
+
+    const auto after = analyze_vertex_cache(indices, vertices.size());
+    std::ostringstream message;
+    message << "MESH_OPTIMIZER::" << path << " mesh " << mesh_index << ": ACMR " << before.acmr << " -> " << after.acmr
+        << ", ATVR " << before.atvr << " -> " << after.atvr << '\n';
+    std::cout << message.str() << std::flush;
 }
 
-void model::process_node(const aiNode* node, const aiScene* scene)
+void model::compress_mesh(mesh_data& mesh_data, const std::string& path, const size_t mesh_index)
+{
+    const auto geometry_before = mesh_data.get_geometry();
+    const size_t size_before = geometry_before.vertex_count * geometry_before.get_vertex_size() +
+        geometry_before.index_count * geometry_before.get_index_size();
+
+    ::compress_mesh(mesh_data);
+
+    const auto geometry_after = mesh_data.get_geometry();
+    const size_t size_after = geometry_after.vertex_count * geometry_after.get_vertex_size() +
+        geometry_after.index_count * geometry_after.get_index_size();
+
+    std::ostringstream message;
+    message << "MESH_COMPRESSION::" << path << " mesh " << mesh_index << ": bytes " << size_before << " -> " <<
+        size_after << '\n';
+    std::cout << message.str() << std::flush;
+}
+
+void model::build_lods(mesh_data& mesh_data, const model_params& params, const std::string& path,
+                       const size_t mesh_index)
+{
+    const auto& vertices = mesh_data.vertices;
+    auto& indices = mesh_data.indices;
+    auto& lods = mesh_data.lods;
+
+    std::ostringstream message;
+    message << "MESH_LOD::" << path << " mesh " << mesh_index << ": triangles " << indices.size() / 3;
+
+    lods.clear();
+    lods.push_back({0, indices.size(), 0.0f});
+
+    // every level is simplified from the previous one, all of them index the same vertex buffer
+    std::vector<unsigned int> previous(indices);
+    while (lods.size() < params.lod_count)
+    {
+        float error = 0.0f;
+        const size_t target_index_count = previous.size() / 6 * 3;
+        auto simplified = simplify_mesh(vertices, previous, target_index_count, params.lod_max_error, &error);
+
+        // stop once the error bound keeps the simplifier from making real progress
+        if (simplified.empty() || simplified.size() > previous.size() * 9 / 10)
+            break;
+
+        optimize_vertex_cache(simplified, vertices.size());
+        error = std::max(error, lods.back().error);
+        lods.push_back({indices.size(), simplified.size(), error});
+        indices.insert(indices.end(), simplified.begin(), simplified.end());
+        message << " -> " << simplified.size() / 3 << " (error " << error << ")";
+        previous = std::move(simplified);
+    }
+
+    message << '\n';
+    std::cout << message.str() << std::flush;
+}
+
+void model::cluster_mesh(mesh_data& mesh_data, const std::string& path, const size_t mesh_index)
+{
+    const size_t index_count = mesh_data.lods.empty() ? mesh_data.indices.size() : mesh_data.lods[0].index_count;
+    mesh_data.meshlets = build_meshlets(mesh_data.vertices, mesh_data.indices, 0, index_count);
+
+    size_t cone_count = 0;
+    for (const auto& meshlet : mesh_data.meshlets)
+    {
+        if (meshlet.cone_cutoff < 1.0f)
+            ++cone_count;
+    }
+
+    std::ostringstream message;
+    message << "MESH_MESHLETS::" << path << " mesh " << mesh_index << ": " << mesh_data.meshlets.size() <<
+        " meshlets, " << index_count / 3 / std::max<size_t>(mesh_data.meshlets.size(), 1) <<
+        " triangles on average, " << cone_count << " with a normal cone" << '\n';
+    std::cout << message.str() << std::flush;
+}
+
+void model::upload_mesh(const size_t mesh_index)
+{
+    profile_scope scope("upload", path_);
+    if (imported_.mapped_meshes)
+    {
+        const auto& cached_mesh = (*imported_.mapped_meshes)[mesh_index];
+        meshes_.emplace_back(cached_mesh.geometry, load_textures(cached_mesh.textures), params_.cpu_retention);
+    }
+    else
+    {
+        auto& mesh_data = imported_.meshes[mesh_index];
+        auto textures = load_textures(mesh_data.textures);
+        meshes_.emplace_back(std::move(mesh_data), std::move(textures), params_.cpu_retention);
+    }
+
+    meshes_uploaded_ = mesh_index + 1;
+}
+
+void model::finish_loading()
+{
+    const char* source = imported_.package ? "cooked package, " : imported_.cache ? "mesh cache hit, " :
+                             params_.use_mesh_cache ? "mesh cache miss, " : "";
+    // nothing references the imported data anymore, this also unmaps the package or the cache file
+    imported_ = import_result();
+    ready_ = true;
+
+    if (!meshes_.empty())
+    {
+        glm::vec3 min(std::numeric_limits<float>::max());
+        glm::vec3 max(-std::numeric_limits<float>::max());
+        lod_count_ = 0;
+        for (const auto& mesh : meshes_)
+        {
+            min = glm::min(min, mesh.get_bounds_center() - glm::vec3(mesh.get_bounds_radius()));
+            max = glm::max(max, mesh.get_bounds_center() + glm::vec3(mesh.get_bounds_radius()));
+            lod_count_ = std::max(lod_count_, mesh.get_lod_count());
+        }
+
+        bounds_center_ = (min + max) * 0.5f;
+        for (const auto& mesh : meshes_)
+            bounds_radius_ = std::max(bounds_radius_, glm::length(mesh.get_bounds_center() - bounds_center_) +
+                                      mesh.get_bounds_radius());
+    }
+
+    const std::chrono::duration<double, std::milli> load_time = std::chrono::steady_clock::now() - load_start_time_;
+    std::cout << "MODEL::LOADED " << path_ << " in " << load_time.count() << " ms (" << source <<
+        thread_pool::shared().get_thread_count() << " decode threads, " << get_resident_cpu_bytes() / 1024 <<
+        " KiB of CPU geometry " << get_retention_name(params_.cpu_retention) << ")" << std::endl;
+}
+
+void model::process_node(const aiNode* node, const aiScene* scene, std::vector<mesh_data>& meshes)
 {
     for (unsigned int i = 0; i < node->mNumMeshes; i++)
     {
         const aiMesh* mesh = scene->mMeshes[node->mMeshes[i]];
-        meshes_.push_back(process_mesh(mesh, scene));
+        meshes.push_back(process_mesh(mesh, scene));
     }
 
     for (unsigned int i = 0; i < node->mNumChildren; i++)
     {
-        process_node(node->mChildren[i], scene);
+        process_node(node->mChildren[i], scene, meshes);
     }
 }
 
-mesh model::process_mesh(const aiMesh* ai_mesh, const aiScene* scene)
+void model::process_node_batched(const aiNode* node, const aiScene* scene, const aiMatrix4x4& parent_transform,
+                                 std::unordered_map<unsigned int, size_t>& mesh_by_material,
+                                 std::vector<mesh_data>& meshes)
 {
-    std::vector<vertex> vertices;
-    std::vector<unsigned int> indices;
-    std::vector<texture> textures;
+    const aiMatrix4x4 transform = parent_transform * node->mTransformation;
+
+    for (unsigned int i = 0; i < node->mNumMeshes; i++)
+    {
+        const aiMesh* ai_mesh = scene->mMeshes[node->mMeshes[i]];
+        auto data = process_mesh(ai_mesh, scene);
+        if (!transform.IsIdentity())
+            transform_vertices(data.vertices, transform);
+
+        const auto batch = mesh_by_material.emplace(ai_mesh->mMaterialIndex, meshes.size());
+        if (batch.second)
+        {
+            meshes.push_back(std::move(data));
+            continue;
+        }
+
+        auto& merged = meshes[batch.first->second];
+        const auto index_offset = static_cast<unsigned int>(merged.vertices.size());
+        merged.vertices.insert(merged.vertices.end(), data.vertices.begin(), data.vertices.end());
+        for (const auto index : data.indices)
+            merged.indices.push_back(index_offset + index);
+    }
+
+    for (unsigned int i = 0; i < node->mNumChildren; i++)
+    {
+        process_node_batched(node->mChildren[i], scene, transform, mesh_by_material, meshes);
+    }
+}
+
+mesh_data model::process_mesh(const aiMesh* ai_mesh, const aiScene* scene)
+{
+    mesh_data data;
+    auto& vertices = data.vertices;
+    auto& indices = data.indices;
+    vertices.reserve(ai_mesh->mNumVertices);
 
     for (size_t i = 0; i < ai_mesh->mNumVertices; ++i)
     {
@@ -136,46 +975,171 @@ mesh model::process_mesh(const aiMesh* ai_mesh, const aiScene* scene)
     }
 
     const aiMaterial* material = scene->mMaterials[ai_mesh->mMaterialIndex];
-    std::vector<texture> diffuse_maps = load_material_textures(material, aiTextureType_DIFFUSE, "texture_diffuse");
-    textures.insert(textures.end(), diffuse_maps.begin(), diffuse_maps.end());
-
-    std::vector<texture> specular_maps = load_material_textures(material, aiTextureType_SPECULAR, "texture_specular");
-    textures.insert(textures.end(), specular_maps.begin(), specular_maps.end());
+    collect_material_textures(material, aiTextureType_DIFFUSE, "texture_diffuse", data.textures);
+    collect_material_textures(material, aiTextureType_SPECULAR, "texture_specular", data.textures);
 
-    return {vertices, indices, textures};
+    return data;
 }
 
-std::vector<texture> model::load_material_textures(const aiMaterial* material, const aiTextureType type,
-                                                   const std::string& type_name)
+void model::collect_material_textures(const aiMaterial* material, const aiTextureType type,
+                                      const std::string& type_name, std::vector<texture_reference>& textures)
 {
-    stbi_set_flip_vertically_on_load(params_.texture_flip);
-    std::vector<texture> textures;
-
     for (unsigned int texture_index = 0; texture_index < material->GetTextureCount(type); ++texture_index)
     {
         aiString path;
         material->GetTexture(type, texture_index, &path);
+        textures.push_back({type_name, path.C_Str()});
+    }
+}
+
+void model::decode_textures_async(const std::vector<texture_reference>& references)
+{
+    const auto& registry = texture_registry::instance();
+    const auto& arrays = texture_array_registry::instance();
+
+    for (const auto& reference : references)
+    {
+        auto filename = directory_ + '/' + reference.path;
+        const bool srgb = is_color_texture(reference.type);
+        if (pending_textures_.count(filename) != 0 || registry.contains(filename, params_, srgb) ||
+            (params_.pack_textures && arrays.contains(filename, params_, srgb)) || is_dds_file(filename))
+            continue;
+        // cooked textures are uploaded straight from the package
+        if (imported_.package && imported_.package->contains(get_package_texture_name(reference.path)))
+            continue;
+
+        const bool flip = params_.texture_flip;
+        auto decoded = thread_pool::shared().submit([filename, flip, srgb]
+        {
+            profile_scope scope("load", filename);
+            auto image = decode_image(filename, flip);
+            generate_mipmaps(image, srgb);
+            return image;
+        });
+        pending_textures_.emplace(std::move(filename), std::move(decoded));
+    }
+}
+
+bool model::are_textures_decoded(const std::vector<texture_reference>& references) const
+{
+    for (const auto& reference : references)
+    {
+        const auto pending = pending_textures_.find(directory_ + '/' + reference.path);
+        if (pending != pending_textures_.end() &&
+            pending->second.wait_for(std::chrono::seconds(0)) != std::future_status::ready)
+            return false;
+    }
+
+    return true;
+}
 
-        bool skip = false;
-        for (auto& loaded_index : textures_loaded_)
+std::vector<texture> model::load_textures(const std::vector<texture_reference>& references)
+{
+    std::vector<texture> textures;
+    for (const auto& reference : references)
+    {
+        const bool pack = params_.pack_textures && !packing_failed_;
+        textures.push_back(load_texture(reference, pack));
+        if (pack && !textures.back().array)
+        {
+            // all or nothing, the shaders drawing the model sample either texture arrays or plain textures
+            std::cout << "MODEL::TEXTURES_UNPACKED " << path_ << std::endl;
+            packing_failed_ = true;
+            for (auto& mesh : meshes_)
+                unpack_textures(mesh.textures);
+            unpack_textures(textures);
+        }
+    }
+
+    return textures;
+}
+
+texture model::load_texture(const texture_reference& reference, const bool pack)
+{
+    auto& registry = texture_registry::instance();
+    auto& arrays = texture_array_registry::instance();
+
+    const auto filename = directory_ + '/' + reference.path;
+    const bool srgb = is_color_texture(reference.type);
+
+    packed_texture packed = pack ? arrays.acquire_existing(filename, params_, srgb) : packed_texture();
+    unsigned int texture_id = packed.is_valid() ? 0 : registry.acquire_existing(filename, params_, srgb);
+    // another model may have loaded the texture since it was queued for decoding, the image isn't needed then
+    if (packed.is_valid() || texture_id != 0)
+        pending_textures_.erase(filename);
+    if (!packed.is_valid() && texture_id == 0)
+    {
+        profile_scope scope("upload", filename);
+        // textures that are too large or block compressed can't be packed and become plain textures
+        const auto acquire = [&](const auto& source)
         {
-            if (std::strcmp(loaded_index.path.data(), path.C_Str()) == 0)
+            if (pack)
             {
-                textures.push_back(loaded_index);
-                skip = true;
-                break;
+                packed = arrays.acquire(filename, params_, srgb, source);
+                if (!packed.is_valid())
+                    std::cout << "MODEL::TEXTURE_NOT_PACKED " << filename << std::endl;
             }
-        }
+            if (!packed.is_valid())
+                texture_id = registry.acquire(filename, params_, srgb, source);
+        };
 
-        if (skip) continue;
+        const auto pending = pending_textures_.find(filename);
+        if (pending != pending_textures_.end())
+        {
+            // only the upload happens here, decoding already ran on the worker threads
+            acquire(pending->second.get());
+            pending_textures_.erase(pending);
+        }
+        else if (imported_.package && imported_.package->contains(get_package_texture_name(reference.path)))
+        {
+            acquire(imported_.package->get_texture(get_package_texture_name(reference.path)));
+        }
+        else if (is_dds_file(filename))
+        {
+            acquire(dds_texture(filename).get_texture());
+        }
+        else
+        {
+            auto image = decode_image(filename, params_.texture_flip);
+            generate_mipmaps(image, srgb);
+            acquire(image);
+        }
+    }
 
-        texture texture;
-        texture.id = texture_from_file(path.C_Str(), directory_, params_);
-        texture.type = type_name;
-        texture.path = path.C_Str();
-        textures.push_back(texture);
-        textures_loaded_.push_back(texture);
+    texture texture;
+    texture.id = texture_id;
+    texture.type = reference.type;
+    texture.path = reference.path;
+    if (packed.is_valid())
+    {
+        texture.array = packed.array;
+        texture.layer = packed.layer;
+        packed_acquired_.push_back(packed);
     }
+    else
+    {
+        textures_acquired_.push_back(texture_id);
+    }
+    return texture;
+}
 
-    return textures;
+void model::unpack_textures(std::vector<texture>& textures)
+{
+    for (auto& texture : textures)
+    {
+        if (!texture.array)
+            continue;
+
+        const auto packed = std::find_if(packed_acquired_.begin(), packed_acquired_.end(),
+                                         [&texture](const packed_texture& packed)
+                                         {
+                                             return packed.array == texture.array && packed.layer == texture.layer;
+                                         });
+        if (packed != packed_acquired_.end())
+        {
+            texture_array_registry::instance().release(*packed);
+            packed_acquired_.erase(packed);
+        }
+        texture = load_texture({texture.type, texture.path}, false);
+    }
 }
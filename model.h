@@ -1,14 +1,52 @@
 ﻿#pragma once
+#include <chrono>
+#include <cstdint>
+#include <future>
+#include <memory>
 #include <string>
+#include <unordered_map>
 
+#include "asset_package.h"
+#include "image.h"
 #include "mesh.h"
+#include "mesh_cache.h"
 #include "shader.h"
+#include "texture_array.h"
 #include <assimp/scene.h>
 
 struct model_params
 {
     bool texture_clamp = false;
     bool texture_flip = true;
+    bool use_mesh_cache = true;
+    // load the package written by the asset cooker instead of the source files, if it was cooked with these params
+    bool use_packages = true;
+    // static batching: bake the node transforms into the vertices and merge all meshes sharing a material into one,
+    // so the model draws with one call per material
+    bool batch_meshes = false;
+    // merge vertices closer than weld_epsilon in position, normal and texture coordinates at import time
+    bool weld_vertices = false;
+    float weld_epsilon = 1e-5f;
+    // reorder indices and vertices for the post-transform cache, overdraw and vertex fetch at import time
+    bool optimize_meshes = false;
+    // store vertices as compact_vertex and use 16-bit indices where possible, see vertex_compression.h
+    bool compact_vertices = false;
+    // number of levels of detail including the full mesh, each level aims for half the triangles of the previous one
+    size_t lod_count = 1;
+    // largest simplification error accepted for a level, relative to the mesh extent
+    float lod_max_error = 0.05f;
+    // split the full detail level into meshlets that are culled against the camera one by one when drawing
+    bool build_meshlets = false;
+    // store the textures of the cooked package block compressed (BC1/BC3/BC5), see texture_compression.h
+    bool compress_textures = false;
+    // what each mesh keeps in CPU memory after its upload; only affects the loaded model, not the imported data
+    mesh_retention cpu_retention = mesh_retention::discard;
+    // put small textures into layers of shared texture arrays, see texture_array.h; if any texture can't be packed the
+    // model keeps plain textures, model::has_texture_arrays() tells which kind of sampler its shaders need
+    bool pack_textures = false;
+
+    // identifies everything that affects the imported or cooked data, used as part of the mesh cache and package keys
+    std::uint64_t hash() const;
 
     static model_params get_default()
     {
@@ -19,24 +57,123 @@ struct model_params
 
 unsigned int texture_from_file(const char* path, const std::string& directory, const model_params& model_params,
                                bool gamma = false);
+// must be called on the thread owning the GL context
+unsigned int upload_texture(const image& image, const model_params& model_params, bool gamma = false);
+// Uploads every level stored in the package or DDS file instead of generating mipmaps. Block compressed levels
+// the driver can't sample are decompressed on the CPU first.
+unsigned int upload_texture(const cooked_texture& texture, const model_params& model_params, bool gamma = false);
 
 class model
 {
 public:
+    // loads the whole model before returning
     explicit model(const std::string& path, const model_params& params = model_params::get_default());
+    ~model();
+
+    // returns immediately, importing and decoding run on the worker threads; call update_loading() every frame
+    // to upload the results. The model draws nothing until is_ready() is true.
+    static model load_async(const std::string& path, const model_params& params = model_params::get_default());
+
+    // Imports the model and decodes its textures into an asset package, see asset_package.h. Does nothing if the
+    // package is up to date. Needs no GL context.
+    static bool cook(const std::string& path, const model_params& params = model_params::get_default());
+
+    // the files a load with these params starts by reading, for asset_io::prefetch()
+    static std::vector<std::string> get_input_files(const std::string& path,
+                                                    const model_params& params = model_params::get_default());
+
+    model(const model&) = delete;
+    model& operator=(const model&) = delete;
+    model(model&&) noexcept = default;
+    model& operator=(model&&) = delete;
+
+    bool is_ready() const;
+    // uploads finished work of an asynchronous load, stopping once the time budget is spent
+    void update_loading(float time_budget_ms = 2.0f);
 
     void draw(const shader& shader) const;
-    void draw(const shader& shader, const std::vector<extra_texture>& extra_textures) const;
+    void draw(const shader& shader, const std::vector<extra_texture>& extra_textures, size_t lod = 0) const;
+    // selects the level of detail for one instance and draws it, lod holds the instance's level between frames;
+    // at full detail, meshlets outside the frustum or facing away from the camera are skipped
+    void draw(const shader& shader, const std::vector<extra_texture>& extra_textures, const glm::mat4& model_matrix,
+              const glm::mat4& view, const glm::mat4& projection, size_t& lod) const;
+
+    size_t get_lod_count() const;
+    // the textures of the model are layers of texture arrays, its shaders sample them as sampler2DArray; packing is
+    // all or nothing, if one texture of a pack_textures model can't be packed none of them are
+    bool has_texture_arrays() const;
+    // CPU memory held for the geometry of the meshes, see mesh_retention
+    size_t get_resident_cpu_bytes() const;
+    // Picks the level from the projected size of the bounding sphere: level k is used while the sphere covers less
+    // than lod_screen_size / 2^(k - 1) of the viewport height. A level only changes once the size is lod_hysteresis
+    // past the threshold, so instances sitting on a threshold don't flicker between levels.
+    size_t select_lod(const glm::mat4& model_matrix, const glm::mat4& view, const glm::mat4& projection,
+                      size_t current_lod) const;
+
+    static constexpr float lod_screen_size = 0.5f;
+    static constexpr float lod_hysteresis = 0.1f;
 
 private:
+    // CPU-side result of an import, either mapped from a cooked package or the mesh cache, or produced by Assimp
+    struct import_result
+    {
+        std::unique_ptr<asset_package> package;
+        std::unique_ptr<mesh_cache> cache;
+        // points into the package or the cache when one of them was used
+        const std::vector<cached_mesh>* mapped_meshes = nullptr;
+        std::vector<mesh_data> meshes;
+
+        size_t get_mesh_count() const;
+        const std::vector<texture_reference>& get_textures(size_t mesh_index) const;
+    };
+
     std::vector<mesh> meshes_;
+    std::string path_;
     std::string directory_;
-    std::vector<texture> textures_loaded_;
+    // references held in texture_registry, released when the model is destroyed
+    std::vector<unsigned int> textures_acquired_;
+    // layers held in texture_array_registry, likewise
+    std::vector<packed_texture> packed_acquired_;
+    std::unordered_map<std::string, std::future<image>> pending_textures_;
     model_params params_;
 
-    void load_model(const std::string& path);
-    void process_node(const aiNode* node, const aiScene* scene);
-    mesh process_mesh(const aiMesh* ai_mesh, const aiScene* scene);
-    std::vector<texture> load_material_textures(const aiMaterial* material, aiTextureType type,
-                                                const std::string& type_name);
+    std::future<import_result> pending_import_;
+    import_result imported_;
+    size_t meshes_uploaded_;
+    bool textures_requested_;
+    // a texture couldn't be packed, the model's textures are all plain ones since
+    bool packing_failed_;
+    bool ready_;
+    std::chrono::steady_clock::time_point load_start_time_;
+
+    // union of the mesh bounding spheres in model space
+    glm::vec3 bounds_center_;
+    float bounds_radius_;
+    size_t lod_count_;
+
+    model(std::string path, const model_params& params, std::future<import_result> pending_import);
+
+    static import_result import_model(const std::string& path, const model_params& params);
+    static void process_node(const aiNode* node, const aiScene* scene, std::vector<mesh_data>& meshes);
+    // process_node() for batch_meshes, mesh_by_material maps a material index to its mesh in meshes
+    static void process_node_batched(const aiNode* node, const aiScene* scene, const aiMatrix4x4& parent_transform,
+                                     std::unordered_map<unsigned int, size_t>& mesh_by_material,
+                                     std::vector<mesh_data>& meshes);
+    static void weld_mesh(mesh_data& mesh_data, float epsilon, const std::string& path, size_t mesh_index);
+    static void optimize_mesh(mesh_data& mesh_data, const std::string& path, size_t mesh_index);
+    static void compress_mesh(mesh_data& mesh_data, const std::string& path, size_t mesh_index);
+    static void build_lods(mesh_data& mesh_data, const model_params& params, const std::string& path,
+                           size_t mesh_index);
+    static void cluster_mesh(mesh_data& mesh_data, const std::string& path, size_t mesh_index);
+    static mesh_data process_mesh(const aiMesh* ai_mesh, const aiScene* scene);
+    static void collect_material_textures(const aiMaterial* material, aiTextureType type, const std::string& type_name,
+                                          std::vector<texture_reference>& textures);
+    void decode_textures_async(const std::vector<texture_reference>& references);
+    bool are_textures_decoded(const std::vector<texture_reference>& references) const;
+    std::vector<texture> load_textures(const std::vector<texture_reference>& references);
+    texture load_texture(const texture_reference& reference, bool pack);
+    // replaces the packed textures by plain ones and releases their layers
+    void unpack_textures(std::vector<texture>& textures);
+    void upload_mesh(size_t mesh_index);
+    void finish_loading();
 };
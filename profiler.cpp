@@ -0,0 +1,234 @@
+﻿#include "profiler.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <map>
+
+namespace
+{
+    // innermost open scope of the calling thread
+    thread_local profile_scope* current_scope = nullptr;
+
+    std::string escape_json(const std::string& value)
+    {
+        std::string escaped;
+        escaped.reserve(value.size());
+        for (const char c : value)
+        {
+            if (c == '"' || c == '\\')
+            {
+                escaped += '\\';
+                escaped += c;
+            }
+            else if (static_cast<unsigned char>(c) < 0x20)
+            {
+                char code[8];
+                std::snprintf(code, sizeof(code), "\\u%04x", c);
+                escaped += code;
+            }
+            else
+            {
+                escaped += c;
+            }
+        }
+        return escaped;
+    }
+
+    std::string format_milliseconds(const std::int64_t microseconds)
+    {
+        char text[32];
+        std::snprintf(text, sizeof(text), "%.1f", static_cast<double>(microseconds) / 1000.0);
+        return text;
+    }
+}
+
+profiler& profiler::instance()
+{
+    static profiler profiler;
+    return profiler;
+}
+
+profiler::profiler():
+    start_time_(std::chrono::steady_clock::now())
+{
+    thread_indices_.emplace(std::this_thread::get_id(), 0);
+}
+
+bool profiler::is_recording() const
+{
+    return recording_;
+}
+
+void profiler::stop()
+{
+    recording_ = false;
+}
+
+void profiler::add_event(profile_event event)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    event.thread_index = get_thread_index(std::this_thread::get_id());
+    events_.push_back(std::move(event));
+}
+
+void profiler::mark(const std::string& name)
+{
+    if (!recording_)
+        return;
+
+    const auto time = get_time();
+    std::lock_guard<std::mutex> lock(mutex_);
+    marks_.push_back({name, time});
+}
+
+std::int64_t profiler::get_time() const
+{
+    return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start_time_).
+        count();
+}
+
+bool profiler::write_trace(const std::string& path) const
+{
+    std::ofstream stream(path, std::ios::trunc);
+    if (!stream)
+    {
+        std::cout << "ERROR::PROFILER::TRACE_NOT_WRITTEN " << path << std::endl;
+        return false;
+    }
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    stream << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n";
+
+    for (const auto& [id, index] : thread_indices_)
+    {
+        const auto thread_name = index == 0 ? std::string("main") : "worker " + std::to_string(index);
+        stream << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" << index <<
+            ",\"args\":{\"name\":\"" << thread_name << "\"}},\n";
+    }
+
+    for (const auto& event : events_)
+    {
+        stream << "{\"name\":\"" << escape_json(event.name.empty() ? event.category : event.name) << "\",\"cat\":\""
+            << escape_json(event.category) << "\",\"ph\":\"X\",\"pid\":1,\"tid\":" << event.thread_index <<
+            ",\"ts\":" << event.start << ",\"dur\":" << event.duration << "},\n";
+    }
+
+    for (const auto& mark : marks_)
+    {
+        stream << "{\"name\":\"" << escape_json(mark.name) << "\",\"ph\":\"i\",\"s\":\"g\",\"pid\":1,\"tid\":0,"
+            "\"ts\":" << mark.time << "},\n";
+    }
+
+    // the format allows no trailing comma, close with an event that carries no information
+    stream << "{\"name\":\"trace_end\",\"ph\":\"M\",\"pid\":1,\"tid\":0,\"args\":{}}\n]}\n";
+    return static_cast<bool>(stream);
+}
+
+void profiler::print_summary(const std::string& label) const
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    // categories in the order they were first seen, which roughly follows the loading pipeline
+    std::vector<std::string> categories;
+    std::map<std::string, std::map<std::string, std::int64_t>> asset_times;
+    std::map<std::string, std::int64_t> category_totals;
+    for (const auto& event : events_)
+    {
+        if (std::find(categories.begin(), categories.end(), event.category) == categories.end())
+            categories.push_back(event.category);
+        asset_times[event.name][event.category] += event.self_duration;
+        category_totals[event.category] += event.self_duration;
+    }
+
+    size_t name_width = 5;
+    for (const auto& [name, times] : asset_times)
+        name_width = std::max(name_width, name.size());
+    constexpr size_t column_width = 10;
+
+    const auto print_row = [&](const std::string& name, const std::vector<std::string>& columns)
+    {
+        std::string row = "PROFILE::" + label + " " + name + std::string(name_width - name.size(), ' ');
+        for (const auto& column : columns)
+            row += std::string(column_width - std::min(column_width - 1, column.size()), ' ') + column;
+        std::cout << row << '\n';
+    };
+
+    std::vector<std::string> header = categories;
+    header.emplace_back("total");
+    print_row("asset", header);
+
+    // times are self times in ms summed over all threads, so with workers the total exceeds the wall time
+    const auto print_times = [&](const std::string& name, const std::map<std::string, std::int64_t>& times)
+    {
+        std::vector<std::string> columns;
+        std::int64_t total = 0;
+        for (const auto& category : categories)
+        {
+            const auto time = times.find(category);
+            columns.push_back(time != times.end() ? format_milliseconds(time->second) : "-");
+            total += time != times.end() ? time->second : 0;
+        }
+        columns.push_back(format_milliseconds(total));
+        print_row(name, columns);
+    };
+
+    for (const auto& [name, times] : asset_times)
+        print_times(name.empty() ? "(other)" : name, times);
+    print_times("total", category_totals);
+
+    for (const auto& mark : marks_)
+        std::cout << "PROFILE::" << label << " " << mark.name << " at " << format_milliseconds(mark.time) << " ms\n";
+    std::cout << std::flush;
+}
+
+size_t profiler::get_thread_index(const std::thread::id id)
+{
+    const auto index = thread_indices_.find(id);
+    if (index != thread_indices_.end())
+        return index->second;
+
+    const size_t new_index = thread_indices_.size();
+    thread_indices_.emplace(id, new_index);
+    return new_index;
+}
+
+profile_scope::profile_scope(const char* category, std::string name):
+    category_(category),
+    name_(std::move(name)),
+    start_(0),
+    nested_duration_(0),
+    parent_(nullptr),
+    recording_(profiler::instance().is_recording())
+{
+    if (!recording_)
+        return;
+
+    parent_ = current_scope;
+    if (name_.empty() && parent_)
+        name_ = parent_->name_;
+    current_scope = this;
+    start_ = profiler::instance().get_time();
+}
+
+profile_scope::~profile_scope()
+{
+    if (!recording_)
+        return;
+
+    auto& profiler = profiler::instance();
+    const auto duration = profiler.get_time() - start_;
+    current_scope = parent_;
+    if (parent_)
+        parent_->nested_duration_ += duration;
+
+    profile_event event;
+    event.category = category_;
+    event.name = std::move(name_);
+    event.thread_index = 0;
+    event.start = start_;
+    event.duration = duration;
+    event.self_duration = duration - nested_duration_;
+    profiler.add_event(std::move(event));
+}
@@ -0,0 +1,85 @@
+﻿#pragma once
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+// One finished profile_scope, times in microseconds since the profiler was created
+struct profile_event
+{
+    std::string category;
+    std::string name;
+    size_t thread_index;
+    std::int64_t start;
+    std::int64_t duration;
+    // duration minus the scopes nested in it on the same thread, what the summary adds up
+    std::int64_t self_duration;
+};
+
+// Records the startup: which asset spent how long in which stage (import, decode, mips, upload, compile, link...),
+// on which thread. Recording starts when the profiler is first used, which main() does before anything else, and
+// ends with stop(). The result is written as a Chrome trace (chrome://tracing, Perfetto) and printed as a table.
+class profiler
+{
+public:
+    static profiler& instance();
+
+    bool is_recording() const;
+    // scopes opened after this are not recorded, the recorded events stay available
+    void stop();
+
+    void add_event(profile_event event);
+    // a point in time, e.g. the first frame, shown as an instant event in the trace
+    void mark(const std::string& name);
+    // microseconds since the profiler was created
+    std::int64_t get_time() const;
+
+    // writes the events in the Chrome trace event format
+    bool write_trace(const std::string& path) const;
+    // prints the self time of each asset per category as PROFILE::<label>, followed by the marks
+    void print_summary(const std::string& label) const;
+
+private:
+    struct mark_event
+    {
+        std::string name;
+        std::int64_t time;
+    };
+
+    const std::chrono::steady_clock::time_point start_time_;
+    std::atomic<bool> recording_{true};
+    mutable std::mutex mutex_;
+    std::vector<profile_event> events_;
+    std::vector<mark_event> marks_;
+    // the thread that created the profiler is 0, the others are numbered as they record their first event
+    std::unordered_map<std::thread::id, size_t> thread_indices_;
+
+    profiler();
+
+    size_t get_thread_index(std::thread::id id);
+};
+
+// Times the enclosing block as one event. Scopes nest per thread: a scope without a name belongs to the asset of the
+// scope it is nested in, e.g. generate_mipmaps() is attributed to the texture being loaded around it.
+class profile_scope
+{
+public:
+    explicit profile_scope(const char* category, std::string name = std::string());
+    ~profile_scope();
+
+    profile_scope(const profile_scope&) = delete;
+    profile_scope& operator=(const profile_scope&) = delete;
+
+private:
+    const char* category_;
+    std::string name_;
+    std::int64_t start_;
+    std::int64_t nested_duration_;
+    profile_scope* parent_;
+    bool recording_;
+};
@@ -0,0 +1,175 @@
+﻿#include "program_cache.h"
+
+#include <cstring>
+#include <iostream>
+#include <memory>
+#include <vector>
+
+#include "asset_io.h"
+#include "binary_io.h"
+#include "hash.h"
+#include "thread_pool.h"
+
+namespace
+{
+    // GL 4.1 / ARB_get_program_binary, not part of the 3.3 loader
+    constexpr GLenum program_binary_retrievable_hint = 0x8257;
+    constexpr GLenum program_binary_length = 0x8741;
+    constexpr GLenum num_program_binary_formats = 0x87FE;
+
+    using get_program_binary_function = void (APIENTRYP)(GLuint program, GLsizei buffer_size, GLsizei* length,
+                                                         GLenum* binary_format, void* binary);
+    using program_binary_function = void (APIENTRYP)(GLuint program, GLenum binary_format, const void* binary,
+                                                     GLsizei length);
+    using program_parameteri_function = void (APIENTRYP)(GLuint program, GLenum name, GLint value);
+
+    get_program_binary_function get_program_binary = nullptr;
+    program_binary_function program_binary = nullptr;
+    program_parameteri_function program_parameteri = nullptr;
+
+    constexpr char program_magic[4] = {'P', 'R', 'G', 'B'};
+
+    struct file_header
+    {
+        char magic[4];
+        std::uint32_t version;
+        std::uint64_t key;
+        std::uint32_t binary_format;
+        std::uint32_t binary_size;
+    };
+
+    bool has_program_binaries()
+    {
+        GLint major = 0, minor = 0, extension_count = 0;
+        glGetIntegerv(GL_MAJOR_VERSION, &major);
+        glGetIntegerv(GL_MINOR_VERSION, &minor);
+        if (major > 4 || (major == 4 && minor >= 1))
+            return true;
+
+        glGetIntegerv(GL_NUM_EXTENSIONS, &extension_count);
+        for (GLint i = 0; i < extension_count; ++i)
+        {
+            const auto name = reinterpret_cast<const char*>(glGetStringi(GL_EXTENSIONS, i));
+            if (name && std::strcmp(name, "GL_ARB_get_program_binary") == 0)
+                return true;
+        }
+        return false;
+    }
+
+    std::string get_gl_string(const GLenum name)
+    {
+        const auto value = reinterpret_cast<const char*>(glGetString(name));
+        return value ? value : "";
+    }
+}
+
+void program_cache::load_functions(const GLADloadproc load)
+{
+    get_program_binary = reinterpret_cast<get_program_binary_function>(load("glGetProgramBinary"));
+    program_binary = reinterpret_cast<program_binary_function>(load("glProgramBinary"));
+    program_parameteri = reinterpret_cast<program_parameteri_function>(load("glProgramParameteri"));
+}
+
+bool program_cache::is_supported()
+{
+    static const bool supported = []
+    {
+        if (!get_program_binary || !program_binary || !program_parameteri || !has_program_binaries())
+            return false;
+
+        // a driver may support the API without offering any format
+        GLint format_count = 0;
+        glGetIntegerv(num_program_binary_formats, &format_count);
+        return format_count > 0;
+    }();
+    return supported;
+}
+
+std::uint64_t program_cache::make_key(const std::uint64_t sources_hash, const std::string& defines)
+{
+    static const std::uint64_t driver_hash = hash_string(get_gl_string(GL_VERSION),
+                                                         hash_string(get_gl_string(GL_RENDERER)));
+
+    std::uint64_t key = hash_value(version);
+    key = hash_value(driver_hash, key);
+    key = hash_value(sources_hash, key);
+    key = hash_string(defines, key);
+    return key;
+}
+
+void program_cache::mark_retrievable(const GLuint program)
+{
+    if (is_supported())
+        program_parameteri(program, program_binary_retrievable_hint, GL_TRUE);
+}
+
+program_load_result program_cache::load(const std::uint64_t key, const GLuint program)
+{
+    if (!is_supported())
+        return program_load_result::not_cached;
+
+    const auto file = asset_io::instance().open(get_path(key));
+    if (!file->is_open())
+        return program_load_result::not_cached;
+
+    binary_reader reader(file->data(), file->size());
+    file_header header{};
+    if (!reader.read_value(header) || std::memcmp(header.magic, program_magic, sizeof program_magic) != 0 ||
+        header.version != version || header.key != key)
+        return program_load_result::not_cached;
+
+    const auto binary = reader.read(header.binary_size);
+    if (!binary)
+        return program_load_result::not_cached;
+
+    program_binary(program, header.binary_format, binary, static_cast<GLsizei>(header.binary_size));
+    GLint success = 0;
+    glGetProgramiv(program, GL_LINK_STATUS, &success);
+    if (!success)
+    {
+        std::cout << "PROGRAM_CACHE::BINARY_REJECTED " << get_path(key) << std::endl;
+        return program_load_result::rejected;
+    }
+
+    return program_load_result::restored;
+}
+
+void program_cache::store(const std::uint64_t key, const GLuint program)
+{
+    if (!is_supported())
+        return;
+
+    GLint length = 0;
+    glGetProgramiv(program, program_binary_length, &length);
+    if (length <= 0)
+        return;
+
+    file_header header{};
+    std::memcpy(header.magic, program_magic, sizeof program_magic);
+    header.version = version;
+    header.key = key;
+
+    auto data = std::make_shared<std::vector<unsigned char>>(sizeof header + static_cast<size_t>(length));
+    GLenum binary_format = 0;
+    GLsizei written = 0;
+    get_program_binary(program, length, &written, &binary_format, data->data() + sizeof header);
+    if (written <= 0)
+        return;
+
+    header.binary_format = binary_format;
+    header.binary_size = static_cast<std::uint32_t>(written);
+    std::memcpy(data->data(), &header, sizeof header);
+    data->resize(sizeof header + static_cast<size_t>(written));
+
+    const auto path = get_path(key);
+    thread_pool::shared().submit([path, data]
+    {
+        if (!write_file_atomically(path, *data))
+            std::cout << "ERROR::PROGRAM_CACHE::FILE_NOT_WRITTEN " << path << std::endl;
+    });
+}
+
+std::string program_cache::get_path(const std::uint64_t key)
+{
+    return std::string(directory) + '/' + hash_to_hex(key) + ".bin";
+}
@@ -0,0 +1,42 @@
+﻿#pragma once
+#include <cstdint>
+#include <string>
+#include <glad/glad.h>
+
+enum class program_load_result
+{
+    restored,
+    // no usable file, glProgramBinary was not called and the program is untouched
+    not_cached,
+    // the driver refused the binary, which leaves the program in an undefined state
+    rejected,
+};
+
+// Linked programs saved with glGetProgramBinary, so later runs skip compiling and linking GLSL. Files are keyed by
+// the stage sources, the defines and the driver (GL_RENDERER and GL_VERSION), a driver update simply misses the cache.
+// The loader is generated for GL 3.3, which predates program binaries; they are used on GL 4.1 or with
+// GL_ARB_get_program_binary and skipped otherwise. Only to be used from the thread owning the GL context.
+class program_cache
+{
+public:
+    // bump whenever the layout of the file changes
+    static constexpr std::uint32_t version = 1;
+    static constexpr const char* directory = "./cache/programs";
+
+    // resolves the entry points missing from the loader, call once after gladLoadGLLoader
+    static void load_functions(GLADloadproc load);
+    static bool is_supported();
+
+    // sources_hash covers the code and type of every stage
+    static std::uint64_t make_key(std::uint64_t sources_hash, const std::string& defines);
+    // to be set before linking a program that is going to be stored
+    static void mark_retrievable(GLuint program);
+    // restores the program from its binary; a program that was not_cached can be linked from source as usual, a
+    // rejected one has to be replaced by a fresh program first
+    static program_load_result load(std::uint64_t key, GLuint program);
+    // reads the binary of the linked program, the file is written in the background
+    static void store(std::uint64_t key, GLuint program);
+
+private:
+    static std::string get_path(std::uint64_t key);
+};
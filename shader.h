@@ -1,181 +1,847 @@
 #pragma once
 
 #include "glad/glad.h"
-#include <fstream>
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
 #include <iostream>
-#include <sstream>
+#include <memory>
 #include <string>
+#include <string_view>
+#include <unordered_map>
+#include <utility>
+#include <vector>
 #include "glm/glm.hpp"
 #include "glm/gtc/matrix_transform.hpp"
 #include "glm/gtc/type_ptr.hpp"
 
+#include "asset_io.h"
+#include "hash.h"
+#include "profiler.h"
+#include "program_cache.h"
+#include "shader_compiler.h"
+
+// Code of a shader stage as handed to glShaderSource, pointing straight into the mapped file. A UTF-8 byte order
+// mark is skipped, GLSL has no notion of one.
+struct shader_source
+{
+    std::string path;
+    std::shared_ptr<const mapped_file> file;
+    // empty if the file could not be read, which the compiler then reports
+    const char* code = "";
+    GLint length = 0;
+
+    bool is_valid() const
+    {
+        return file && file->is_open();
+    }
+};
+
+// A uniform name reduced to its hash, the key of a shader's location table. Hashing a string literal can be done at
+// compile time, but C++17 only guarantees it in a constant expression; names set for every draw are declared as
+// constexpr uniform_id variables, see mesh::bind_material(). Other names are hashed where the uniform_id is made.
+struct uniform_id
+{
+    std::uint64_t hash;
+
+    // hashes the name up to its terminating null, a buffer may be larger than the name it holds
+    template <size_t N>
+    constexpr uniform_id(const char (&name)[N]) : hash(hash_chars(name, get_length(name, N)))
+    {
+    }
+
+    uniform_id(const std::string& name) : hash(hash_chars(name.data(), name.size()))
+    {
+    }
+
+private:
+    static constexpr size_t get_length(const char* name, const size_t size)
+    {
+        size_t length = 0;
+        while (length < size && name[length] != '\0')
+            ++length;
+        return length;
+    }
+};
+
+// Location of a uniform resolved once through shader::get_uniform(), setting it needs no lookup at all. The type
+// selects the glUniform* call; -1 if the program has no such active uniform, setting it then does nothing. The
+// location belongs to the variant selected when the handle was resolved, set() looks it up again by name while another
+// variant is selected.
+template <typename T>
+struct uniform
+{
+    GLint location = -1;
+    // the value the program holds, see shader::set()
+    std::uint32_t shadow_slot = 0;
+    // program the location and the slot belong to
+    unsigned int program = 0;
+    std::uint64_t name_hash = 0;
+};
+
+// glUniform* calls of the frame so far, reset by main() once per frame
+struct uniform_statistics
+{
+    size_t calls_made = 0;
+    // the uniform already held the value, or the program has no such uniform
+    size_t calls_skipped = 0;
+
+    void reset()
+    {
+        calls_made = calls_skipped = 0;
+    }
+};
+
+inline uniform_statistics frame_uniform_statistics;
+
+// Binding points of the uniform blocks every program shares, the buffers behind them are in frame_uniforms.h.
+// GLSL 330 has no layout(binding), programs bind the blocks by name after linking.
+enum class uniform_block : GLuint
+{
+    frame = 0,
+    camera = 1,
+    lights = 2,
+};
+
+inline const char* get_uniform_block_name(const uniform_block block)
+{
+    switch (block)
+    {
+    case uniform_block::frame:
+        return "Frame";
+    case uniform_block::camera:
+        return "Camera";
+    case uniform_block::lights:
+        return "Lights";
+    }
+    return "";
+}
+
+// set of a shader's keywords, one bit each as returned by shader::get_keyword()
+using shader_keywords = std::uint32_t;
+
+// A GLSL program with optional permutations. Keywords name features of the shader code; the variant enabling some of
+// them is compiled with a "#define <keyword>" line for each, inserted after #version of the stages mentioning it. A
+// variant is compiled the first time it is submitted or selected, use() without keywords selects the one without any.
+// Uniform locations, and the handles from get_uniform(), belong to the selected variant. In shader_compile_mode::batch
+// a variant's program is only submitted to the driver at first, its status is checked once it is used or a uniform is
+// looked up.
 class shader
 {
 public:
-    unsigned int id;
+    static constexpr size_t max_keywords = 32;
 
-    shader(const char* vertex_path, const char* fragment_path, const char* geometry_path = nullptr);
+    // program of the selected variant, 0 until one is selected
+    mutable unsigned int id = 0;
 
+    shader(const char* vertex_path, const char* fragment_path, const char* geometry_path = nullptr,
+           std::vector<std::string> keywords = {});
+
+    // makes the selected variant current, the one without keywords if none was selected yet
     void use() const;
+    // selects the variant enabling exactly the given keywords, compiling it on first use, and makes it current
+    void use(shader_keywords keywords) const;
+    // compiles the variant without selecting it, so in batch mode the driver can work on it before it is used
+    void submit(shader_keywords keywords = 0) const;
+
+    // 0 if the shader has no such keyword, enabling it then changes nothing
+    shader_keywords get_keyword(const std::string& name) const;
+    size_t get_variant_count() const;
+
+    GLint get_location(uniform_id name) const;
+    template <typename T>
+    uniform<T> get_uniform(const uniform_id name) const
+    {
+        return resolve_uniform<T>(name.hash);
+    }
 
-    void set_bool(const std::string& name, bool value) const;
-    void set_int(const std::string& name, int value) const;
-    void set_float(const std::string& name, float value) const;
-    void set_mat4(const std::string& name, glm::mat4 value) const;
-    void set_vec3(const std::string& name, float x, float y, float z) const;
-    void set_vec3(const std::string& name, glm::vec3 value) const;
-    void set_vec2(const std::string& name, float x, float y) const;
+    // Each variant keeps a copy of the values it was given, setting a uniform to the value it already holds returns
+    // without a GL call. Uniforms therefore have to be set through the shader, not with glUniform* directly, and only
+    // while it is in use; a call made otherwise goes to the bound program, as glUniform* does, and is never skipped.
+    void set(uniform<bool> uniform, bool value) const;
+    void set(uniform<int> uniform, int value) const;
+    void set(uniform<float> uniform, float value) const;
+    void set(uniform<glm::vec2> uniform, glm::vec2 value) const;
+    void set(uniform<glm::vec3> uniform, glm::vec3 value) const;
+    void set(uniform<glm::mat4> uniform, const glm::mat4& value) const;
+
+    void set_bool(uniform_id name, bool value) const;
+    void set_int(uniform_id name, int value) const;
+    void set_float(uniform_id name, float value) const;
+    void set_mat4(uniform_id name, const glm::mat4& value) const;
+    void set_vec3(uniform_id name, float x, float y, float z) const;
+    void set_vec3(uniform_id name, glm::vec3 value) const;
+    void set_vec2(uniform_id name, float x, float y) const;
 
 private:
-    void compile_shader(const char* vertex_shader_code, const char* fragment_shader_code,
-                        const char* geometry_shader_code = nullptr);
+    struct uniform_entry
+    {
+        std::uint64_t hash;
+        GLint location;
+        std::uint32_t shadow_slot;
+    };
+
+    // last values set, one slot per location; array elements and their "name" alias share a slot
+    struct uniform_shadow
+    {
+        struct slot
+        {
+            std::uint32_t offset;
+            std::uint32_t size;
+            // nothing was set yet, the program may hold anything from its GLSL initializer
+            bool known;
+        };
+
+        std::vector<slot> slots;
+        std::vector<unsigned char> values;
+    };
+
+    // stages of a program submitted for linking, until its status was checked
+    struct pending_link
+    {
+        std::uint64_t cache_key = 0;
+        unsigned int vertex = 0, fragment = 0, geometry = 0;
+        // serial mode checks the stages as they are compiled
+        bool stages_checked = false;
+        bool finished = false;
+    };
+
+    struct variant
+    {
+        shader_keywords keywords = 0;
+        unsigned int id = 0;
+        // active uniforms by name hash, sorted for binary search; filled once after linking
+        std::vector<uniform_entry> uniforms;
+        // shared with copies of the shader, which use the same program
+        std::shared_ptr<uniform_shadow> shadow;
+        // set while the program is not checked yet, shared with copies of the shader so only one of them finishes it
+        std::shared_ptr<pending_link> pending;
+    };
+
+    // stay mapped for variants compiled later; no geometry stage if its path is empty
+    shader_source vertex_source_, fragment_source_, geometry_source_;
+    std::vector<std::string> keywords_;
+    static constexpr size_t no_variant = static_cast<size_t>(-1);
+
+    // the program use() made current and its shadow; glUniform* calls go to it, whichever shader makes them
+    static inline unsigned int bound_program_ = 0;
+    static inline std::weak_ptr<uniform_shadow> bound_shadow_;
+
+    // permutation table, a shader has a handful of variants at most so it is searched linearly; mutable as variants
+    // are compiled and finished on first use
+    mutable std::vector<variant> variants_;
+    mutable size_t selected_variant_ = no_variant;
+
+    // index of the variant, compiled if it is not in the table yet
+    size_t find_variant(shader_keywords keywords) const;
+    variant& get_selected_variant() const;
+    std::string get_defines(shader_keywords keywords) const;
+    // only the keywords the stage's code mentions, so a stage that doesn't use a keyword is shared between variants
+    std::string get_defines(shader_keywords keywords, const shader_source& source) const;
+    // submits the variant's program, and waits for it in serial mode
+    void compile_shader(variant& variant) const;
+    // checks the status of a submitted program and reads its uniforms, nothing to do if it was finished already
+    void finish_compile(variant& variant) const;
+    std::string get_link_name() const;
+    // the same code with the same defines always gives the same key, whichever file it came from
+    static std::uint64_t get_stage_key(GLenum type, const shader_source& source, const std::string& defines);
+    // the stage object shared through shader_compiler's cache, compiled on the first request
+    static unsigned int get_stage(GLenum type, const shader_source& source, const std::string& defines);
+    static unsigned int compile_stage(GLenum type, const shader_source& source, const std::string& defines);
+    // logs the compile errors of the stage, false if there were any
+    static bool check_stage(GLenum type, unsigned int stage, const std::string& path);
+    // Reads the active uniforms with glGetActiveUniform. Array elements are listed as "name[i]" and the first one as
+    // "name" as well, the way glGetUniformLocation accepts them.
+    static void reflect_uniforms(variant& variant);
+    static std::uint32_t get_uniform_value_size(GLenum type);
+    const uniform_entry* find_uniform(std::uint64_t name_hash) const;
+    template <typename T>
+    uniform<T> resolve_uniform(std::uint64_t name_hash) const;
+    // records the value in the shadow, false if the uniform already holds it or does not exist; a handle resolved for
+    // another variant is resolved again first
+    template <typename T>
+    bool update_shadow(uniform<T>& uniform, const T& value) const;
+    // connects the uniform blocks the program declares to their shared binding points
+    static void bind_uniform_blocks(unsigned int program);
 };
 
-inline std::string shader_read_all_lines(const std::string& path)
+inline shader_source shader_read_source(const std::string& path)
 {
-    std::ifstream file;
-    constexpr int exception_mask = std::ifstream::failbit | std::ifstream::badbit;
-    file.exceptions(exception_mask);
+    shader_source source;
+    source.path = path;
+    source.file = asset_io::instance().open(path);
+    if (!source.file->is_open())
+        return source;
+
+    auto code = reinterpret_cast<const char*>(source.file->data());
+    size_t length = source.file->size();
+    if (length >= 3 && std::char_traits<char>::compare(code, "\xEF\xBB\xBF", 3) == 0)
+    {
+        code += 3;
+        length -= 3;
+    }
 
-    file.open(path);
-    std::ostringstream output_stream;
-    output_stream << file.rdbuf();
-    std::string result = output_stream.str();
+    source.code = code;
+    source.length = static_cast<GLint>(length);
+    return source;
+}
 
-    return result;
+inline std::uint64_t shader::get_stage_key(const GLenum type, const shader_source& source,
+                                           const std::string& defines)
+{
+    std::uint64_t key = hash_value(type);
+    key = hash_bytes(source.code, static_cast<size_t>(source.length), key);
+    return hash_string(defines, key);
 }
 
-inline void shader::compile_shader(const char* vertex_shader_code, const char* fragment_shader_code,
-                                   const char* geometry_shader_code)
+inline unsigned int shader::get_stage(const GLenum type, const shader_source& source, const std::string& defines)
 {
-    int success;
-    constexpr size_t info_log_size = 512;
-    char info_log[info_log_size];
+    const auto key = get_stage_key(type, source, defines);
+    unsigned int stage = shader_compiler::find_stage(key);
+    if (stage == 0)
+    {
+        stage = compile_stage(type, source, defines);
+        shader_compiler::add_stage(key, stage);
+    }
+    return stage;
+}
+
+inline unsigned int shader::compile_stage(const GLenum type, const shader_source& source, const std::string& defines)
+{
+    // the defines go right after the #version line, which has to come first; #line keeps the compiler's line numbers
+    // matching the file
+    size_t prefix_length = 0;
+    const std::string_view code(source.code, static_cast<size_t>(source.length));
+    const auto version = code.find("#version");
+    if (version != std::string_view::npos)
+    {
+        const auto line_end = code.find('\n', version);
+        prefix_length = line_end == std::string_view::npos ? code.size() : line_end + 1;
+    }
+    const auto line = std::count(code.begin(), code.begin() + static_cast<std::ptrdiff_t>(prefix_length), '\n') + 1;
+    const auto injected = defines + "#line " + std::to_string(line) + "\n";
+
+    const char* strings[] = {source.code, injected.c_str(), source.code + prefix_length};
+    const GLint lengths[] = {
+        static_cast<GLint>(prefix_length), static_cast<GLint>(injected.size()),
+        static_cast<GLint>(code.size() - prefix_length)
+    };
+
+    // in serial mode the status is queried right away, which waits for the driver, so the scope covers the actual
+    // compile; in batch mode only the submission
+    profile_scope scope("compile", source.path);
+    const unsigned int stage = glCreateShader(type);
+    if (defines.empty())
+        glShaderSource(stage, 1, &source.code, &source.length);
+    else
+        glShaderSource(stage, 3, strings, lengths);
+    glCompileShader(stage);
+    if (shader_compiler::get_mode() == shader_compile_mode::serial)
+        check_stage(type, stage, source.path);
 
-    const unsigned int vertex = glCreateShader(GL_VERTEX_SHADER);
-    glShaderSource(vertex, 1, &vertex_shader_code, nullptr);
-    glCompileShader(vertex);
+    return stage;
+}
 
-    glGetShaderiv(vertex, GL_COMPILE_STATUS, &success);
+inline bool shader::check_stage(const GLenum type, const unsigned int stage, const std::string& path)
+{
+    int success;
+    glGetShaderiv(stage, GL_COMPILE_STATUS, &success);
     if (!success)
     {
-        glGetShaderInfoLog(vertex, info_log_size, nullptr, info_log);
-        std::cout << "ERROR::SHADER::VERTEX::COMPILATION_FAILED\n" << info_log << std::endl;
+        constexpr size_t info_log_size = 512;
+        char info_log[info_log_size];
+        glGetShaderInfoLog(stage, info_log_size, nullptr, info_log);
+        const char* stage_name = type == GL_VERTEX_SHADER ? "VERTEX" : type == GL_FRAGMENT_SHADER ? "FRAGMENT" :
+                                     "GEOMETRY";
+        std::cout << "ERROR::SHADER::" << stage_name << "::COMPILATION_FAILED " << path << "\n" << info_log
+            << std::endl;
     }
+    return success;
+}
 
-    const unsigned int fragment = glCreateShader(GL_FRAGMENT_SHADER);
-    glShaderSource(fragment, 1, &fragment_shader_code, nullptr);
-    glCompileShader(fragment);
+inline void shader::compile_shader(variant& variant) const
+{
+    const auto start_time = profiler::instance().get_time();
+    const shader_source* geometry_source = geometry_source_.path.empty() ? nullptr : &geometry_source_;
+    const auto defines = get_defines(variant.keywords);
+    variant.shadow = std::make_shared<uniform_shadow>();
+
+    std::uint64_t sources_hash = hash_value(GL_VERTEX_SHADER);
+    sources_hash = hash_bytes(vertex_source_.code, static_cast<size_t>(vertex_source_.length), sources_hash);
+    sources_hash = hash_value(GL_FRAGMENT_SHADER, sources_hash);
+    sources_hash = hash_bytes(fragment_source_.code, static_cast<size_t>(fragment_source_.length), sources_hash);
+    if (geometry_source)
+    {
+        sources_hash = hash_value(GL_GEOMETRY_SHADER, sources_hash);
+        sources_hash = hash_bytes(geometry_source->code, static_cast<size_t>(geometry_source->length), sources_hash);
+    }
+    const auto cache_key = program_cache::make_key(sources_hash, defines);
 
-    glGetShaderiv(fragment, GL_COMPILE_STATUS, &success);
-    if (!success)
+    variant.id = glCreateProgram();
+    program_load_result loaded;
     {
-        glGetShaderInfoLog(fragment, info_log_size, nullptr, info_log);
-        std::cout << "ERROR::SHADER::FRAGMENT::COMPILATION_FAILED\n" << info_log << std::endl;
+        profile_scope scope("link", get_link_name());
+        loaded = program_cache::load(cache_key, variant.id);
     }
+    if (loaded == program_load_result::restored)
+    {
+        reflect_uniforms(variant);
+        bind_uniform_blocks(variant.id);
+        shader_compiler::add_build_time(profiler::instance().get_time() - start_time, 1);
+        return;
+    }
+    // a rejected binary leaves the program in an undefined state, start over with a fresh one
+    if (loaded == program_load_result::rejected)
+    {
+        glDeleteProgram(variant.id);
+        variant.id = glCreateProgram();
+    }
+
+    auto pending = std::make_shared<pending_link>();
+    pending->cache_key = cache_key;
+    pending->stages_checked = shader_compiler::get_mode() == shader_compile_mode::serial;
+    pending->vertex = get_stage(GL_VERTEX_SHADER, vertex_source_, get_defines(variant.keywords, vertex_source_));
+    pending->fragment = get_stage(GL_FRAGMENT_SHADER, fragment_source_,
+                                  get_defines(variant.keywords, fragment_source_));
+    pending->geometry = geometry_source ? get_stage(GL_GEOMETRY_SHADER, *geometry_source,
+                                                    get_defines(variant.keywords, *geometry_source)) : 0;
+
+    {
+        profile_scope scope("link", get_link_name());
+        program_cache::mark_retrievable(variant.id);
+        glAttachShader(variant.id, pending->vertex);
+        glAttachShader(variant.id, pending->fragment);
+        if (geometry_source)
+            glAttachShader(variant.id, pending->geometry);
+        glLinkProgram(variant.id);
+    }
+    variant.pending = std::move(pending);
+    shader_compiler::add_build_time(profiler::instance().get_time() - start_time, 0);
+
+    if (shader_compiler::get_mode() == shader_compile_mode::serial)
+        finish_compile(variant);
+}
+
+inline void shader::finish_compile(variant& variant) const
+{
+    if (!variant.pending)
+        return;
 
-    unsigned int geometry;
-    if (geometry_shader_code)
+    const auto start_time = profiler::instance().get_time();
+    auto& pending = *variant.pending;
+    size_t programs_finished = 0;
+    if (!pending.finished)
     {
-        geometry = glCreateShader(GL_GEOMETRY_SHADER);
-        glShaderSource(geometry, 1, &geometry_shader_code, nullptr);
-        glCompileShader(geometry);
+        const bool has_geometry = !geometry_source_.path.empty();
 
-        glGetShaderiv(geometry, GL_COMPILE_STATUS, &success);
+        int success;
+        // querying the status waits for the driver, so the scope covers whatever of the compile and link is left
+        {
+            profile_scope scope("link", get_link_name());
+            glGetProgramiv(variant.id, GL_LINK_STATUS, &success);
+        }
         if (!success)
         {
-            glGetShaderInfoLog(geometry, info_log_size, nullptr, info_log);
-            std::cout << "ERROR::SHADER::GEOMETRY::COMPILATION_FAILED\n" << info_log << std::endl;
+            // the stage logs tell what went wrong, the program log often just repeats them
+            if (!pending.stages_checked)
+            {
+                check_stage(GL_VERTEX_SHADER, pending.vertex, vertex_source_.path);
+                check_stage(GL_FRAGMENT_SHADER, pending.fragment, fragment_source_.path);
+                if (has_geometry)
+                    check_stage(GL_GEOMETRY_SHADER, pending.geometry, geometry_source_.path);
+            }
+
+            constexpr size_t info_log_size = 512;
+            char info_log[info_log_size];
+            glGetProgramInfoLog(variant.id, info_log_size, nullptr, info_log);
+            std::cout << "ERROR::SHADER::PROGRAM::LINKING_FAILED\n" << info_log << std::endl;
         }
+        else
+        {
+            program_cache::store(pending.cache_key, variant.id);
+        }
+
+        // the stages stay in shader_compiler's cache for other programs, detached they are freed with it
+        glDetachShader(variant.id, pending.vertex);
+        glDetachShader(variant.id, pending.fragment);
+        if (has_geometry)
+            glDetachShader(variant.id, pending.geometry);
+
+        bind_uniform_blocks(variant.id);
+        pending.finished = true;
+        programs_finished = 1;
     }
-    else
+
+    reflect_uniforms(variant);
+    variant.pending.reset();
+    shader_compiler::add_build_time(profiler::instance().get_time() - start_time, programs_finished);
+}
+
+inline std::string shader::get_link_name() const
+{
+    return vertex_source_.path + " + " + fragment_source_.path;
+}
+
+inline void shader::reflect_uniforms(variant& variant)
+{
+    const auto program = variant.id;
+    auto& uniforms = variant.uniforms;
+    uniforms.clear();
+    // values are zero after linking, but initializers in the GLSL code are not known here, so all start unknown.
+    // A copy of the shader reflecting the program again gets the same slots and keeps the values already recorded.
+    auto& shadow = *variant.shadow;
+    const bool build_shadow = shadow.slots.empty();
+    std::unordered_map<GLint, std::uint32_t> slots_by_location;
+
+    const auto add_uniform = [&](const std::string& name, const GLint location, const GLenum type)
     {
-        geometry = 0;
+        const auto next_slot = static_cast<std::uint32_t>(slots_by_location.size());
+        auto [slot, inserted] = slots_by_location.try_emplace(location, next_slot);
+        if (inserted && build_shadow)
+        {
+            const auto size = get_uniform_value_size(type);
+            shadow.slots.push_back({static_cast<std::uint32_t>(shadow.values.size()), size, false});
+            shadow.values.resize(shadow.values.size() + size);
+        }
+        uniforms.push_back({hash_chars(name.data(), name.size()), location, slot->second});
+    };
+
+    GLint uniform_count = 0, max_name_length = 0;
+    glGetProgramiv(program, GL_ACTIVE_UNIFORMS, &uniform_count);
+    glGetProgramiv(program, GL_ACTIVE_UNIFORM_MAX_LENGTH, &max_name_length);
+    std::vector<char> name_buffer(static_cast<size_t>(std::max(max_name_length, 1)));
+
+    for (GLint i = 0; i < uniform_count; ++i)
+    {
+        GLsizei name_length = 0;
+        GLint size = 0;
+        GLenum type = 0;
+        glGetActiveUniform(program, static_cast<GLuint>(i), static_cast<GLsizei>(name_buffer.size()), &name_length,
+                           &size, &type, name_buffer.data());
+        std::string name(name_buffer.data(), static_cast<size_t>(name_length));
+
+        // uniforms in blocks have no location
+        const GLint location = glGetUniformLocation(program, name.c_str());
+        if (location < 0)
+            continue;
+        add_uniform(name, location, type);
+
+        const auto array_suffix = name.rfind("[0]");
+        if (array_suffix == std::string::npos || array_suffix + 3 != name.size())
+            continue;
+
+        name.resize(array_suffix);
+        add_uniform(name, location, type);
+        // element locations are not guaranteed to be consecutive, each one is queried
+        for (GLint element = 1; element < size; ++element)
+        {
+            const auto element_name = name + "[" + std::to_string(element) + "]";
+            add_uniform(element_name, glGetUniformLocation(program, element_name.c_str()), type);
+        }
     }
 
+    std::sort(uniforms.begin(), uniforms.end(), [](const uniform_entry& left, const uniform_entry& right)
+    {
+        return left.hash < right.hash;
+    });
+}
+
+inline std::uint32_t shader::get_uniform_value_size(const GLenum type)
+{
+    switch (type)
+    {
+    case GL_FLOAT:
+    case GL_INT:
+    case GL_UNSIGNED_INT:
+    case GL_BOOL:
+        return 4;
+    case GL_FLOAT_VEC2:
+    case GL_INT_VEC2:
+    case GL_BOOL_VEC2:
+        return 8;
+    case GL_FLOAT_VEC3:
+    case GL_INT_VEC3:
+    case GL_BOOL_VEC3:
+        return 12;
+    case GL_FLOAT_VEC4:
+    case GL_INT_VEC4:
+    case GL_BOOL_VEC4:
+    case GL_FLOAT_MAT2:
+        return 16;
+    case GL_FLOAT_MAT3:
+        return 36;
+    case GL_FLOAT_MAT4:
+        return 64;
+    default:
+        // samplers and whatever else is set through glUniform1i
+        return 4;
+    }
+}
 
-    id = glCreateProgram();
-    glAttachShader(id, vertex);
-    glAttachShader(id, fragment);
-    if (geometry_shader_code)
-        glAttachShader(id, geometry);
-    glLinkProgram(id);
+inline void shader::bind_uniform_blocks(const unsigned int program)
+{
+    for (const auto block : {uniform_block::frame, uniform_block::camera, uniform_block::lights})
+    {
+        const GLuint index = glGetUniformBlockIndex(program, get_uniform_block_name(block));
+        if (index != GL_INVALID_INDEX)
+            glUniformBlockBinding(program, index, static_cast<GLuint>(block));
+    }
+}
 
-    glGetProgramiv(id, GL_LINK_STATUS, &success);
-    if (!success)
+inline shader::shader(const char* vertex_path, const char* fragment_path, const char* geometry_path,
+                      std::vector<std::string> keywords)
+    :
+    vertex_source_(shader_read_source(vertex_path)),
+    fragment_source_(shader_read_source(fragment_path)),
+    geometry_source_(geometry_path ? shader_read_source(geometry_path) : shader_source()),
+    keywords_(std::move(keywords))
+{
+    if (!vertex_source_.is_valid() || !fragment_source_.is_valid() || (geometry_path && !geometry_source_.is_valid()))
+        std::cout << "ERROR::SHADER::FILE_NOT_SUCCESSFULLY_READ" << std::endl;
+    if (keywords_.size() > max_keywords)
+    {
+        std::cout << "ERROR::SHADER::TOO_MANY_KEYWORDS " << vertex_path << std::endl;
+        keywords_.resize(max_keywords);
+    }
+}
+
+inline void shader::use() const
+{
+    auto& variant = get_selected_variant();
+    finish_compile(variant);
+    glUseProgram(variant.id);
+    bound_program_ = variant.id;
+    bound_shadow_ = variant.shadow;
+}
+
+inline void shader::use(const shader_keywords keywords) const
+{
+    if (selected_variant_ == no_variant || variants_[selected_variant_].keywords != keywords)
     {
-        glGetProgramInfoLog(id, info_log_size, nullptr, info_log);
-        std::cout << "ERROR::SHADER::PROGRAM::LINKING_FAILED\n" << info_log << std::endl;
+        selected_variant_ = find_variant(keywords);
+        id = variants_[selected_variant_].id;
     }
 
-    glDeleteShader(vertex);
-    glDeleteShader(fragment);
-    if (geometry_shader_code)
-        glAttachShader(id, geometry);
+    use();
 }
 
-inline shader::shader(const char* vertex_path, const char* fragment_path, const char* geometry_path)
+inline void shader::submit(const shader_keywords keywords) const
 {
-    std::string vertex_code;
-    std::string fragment_code;
-    std::string geometry_code;
+    find_variant(keywords);
+}
 
-    try
+inline size_t shader::find_variant(const shader_keywords keywords) const
+{
+    const auto it = std::find_if(variants_.begin(), variants_.end(), [keywords](const variant& variant)
+    {
+        return variant.keywords == keywords;
+    });
+    if (it != variants_.end())
+        return static_cast<size_t>(it - variants_.begin());
+
+    variant compiled;
+    compiled.keywords = keywords;
+    compile_shader(compiled);
+    if (keywords != 0)
     {
-        vertex_code = shader_read_all_lines(vertex_path);
-        fragment_code = shader_read_all_lines(fragment_path);
-        if (geometry_path)
-            geometry_code = shader_read_all_lines(geometry_path);
+        std::cout << "SHADER::VARIANT_COMPILED " << fragment_source_.path;
+        for (size_t i = 0; i < keywords_.size(); ++i)
+        {
+            if (keywords & shader_keywords{1} << i)
+                std::cout << ' ' << keywords_[i];
+        }
+        std::cout << std::endl;
     }
-    catch (const std::ifstream::failure&)
+    variants_.push_back(std::move(compiled));
+    return variants_.size() - 1;
+}
+
+inline shader::variant& shader::get_selected_variant() const
+{
+    if (selected_variant_ == no_variant)
     {
-        std::cout << "ERROR::SHADER::FILE_NOT_SUCCESSFULLY_READ" << std::endl;
+        selected_variant_ = find_variant(0);
+        id = variants_[selected_variant_].id;
     }
+    return variants_[selected_variant_];
+}
 
-    const char* vertex_shader_code = vertex_code.c_str();
-    const char* fragment_shader_code = fragment_code.c_str();
-    const char* geometry_shader_code = geometry_path ? geometry_code.c_str() : nullptr;
+inline shader_keywords shader::get_keyword(const std::string& name) const
+{
+    const auto it = std::find(keywords_.begin(), keywords_.end(), name);
+    return it == keywords_.end() ? 0 : shader_keywords{1} << (it - keywords_.begin());
+}
 
-    id = 0;
-    compile_shader(vertex_shader_code, fragment_shader_code, geometry_shader_code);
+inline size_t shader::get_variant_count() const
+{
+    return variants_.size();
 }
 
-inline void shader::use() const
+inline std::string shader::get_defines(const shader_keywords keywords) const
+{
+    std::string defines;
+    for (size_t i = 0; i < keywords_.size(); ++i)
+    {
+        if (keywords & shader_keywords{1} << i)
+            defines += "#define " + keywords_[i] + "\n";
+    }
+    return defines;
+}
+
+inline std::string shader::get_defines(const shader_keywords keywords, const shader_source& source) const
+{
+    // a plain substring search, it may keep a keyword the code doesn't actually test but never drops one it does
+    const std::string_view code(source.code, static_cast<size_t>(source.length));
+    shader_keywords used = 0;
+    for (size_t i = 0; i < keywords_.size(); ++i)
+    {
+        if (code.find(keywords_[i]) != std::string_view::npos)
+            used |= shader_keywords{1} << i;
+    }
+    return get_defines(keywords & used);
+}
+
+inline GLint shader::get_location(const uniform_id name) const
+{
+    const auto entry = find_uniform(name.hash);
+    return entry ? entry->location : -1;
+}
+
+inline const shader::uniform_entry* shader::find_uniform(const std::uint64_t name_hash) const
+{
+    auto& variant = get_selected_variant();
+    finish_compile(variant);
+    const auto& uniforms = variant.uniforms;
+    const auto it = std::lower_bound(uniforms.begin(), uniforms.end(), name_hash,
+                                     [](const uniform_entry& entry, const std::uint64_t hash)
+                                     {
+                                         return entry.hash < hash;
+                                     });
+    return it != uniforms.end() && it->hash == name_hash ? &*it : nullptr;
+}
+
+template <typename T>
+uniform<T> shader::resolve_uniform(const std::uint64_t name_hash) const
+{
+    const auto program = get_selected_variant().id;
+    const auto entry = find_uniform(name_hash);
+    return entry ? uniform<T>{entry->location, entry->shadow_slot, program, name_hash} :
+               uniform<T>{-1, 0, program, name_hash};
+}
+
+template <typename T>
+bool shader::update_shadow(uniform<T>& uniform, const T& value) const
+{
+    if (uniform.program != get_selected_variant().id)
+        uniform = resolve_uniform<T>(uniform.name_hash);
+
+    if (uniform.location < 0)
+    {
+        frame_uniform_statistics.calls_skipped++;
+        return false;
+    }
+
+    // Set while another program is bound, the call changes that one instead. Neither shadow can be trusted with it:
+    // this one isn't touched, and the bound one forgets all its values.
+    const auto& variant = get_selected_variant();
+    if (variant.id != bound_program_)
+    {
+        if (const auto bound_shadow = bound_shadow_.lock())
+        {
+            for (auto& slot : bound_shadow->slots)
+                slot.known = false;
+        }
+        frame_uniform_statistics.calls_made++;
+        return true;
+    }
+
+    // a type larger than the uniform is left to GL to reject
+    auto& shadow = *variant.shadow;
+    if (uniform.shadow_slot < shadow.slots.size() && sizeof(T) <= shadow.slots[uniform.shadow_slot].size)
+    {
+        auto& slot = shadow.slots[uniform.shadow_slot];
+        const auto stored = shadow.values.data() + slot.offset;
+        if (slot.known && std::memcmp(stored, &value, sizeof(T)) == 0)
+        {
+            frame_uniform_statistics.calls_skipped++;
+            return false;
+        }
+        std::memcpy(stored, &value, sizeof(T));
+        slot.known = true;
+    }
+
+    frame_uniform_statistics.calls_made++;
+    return true;
+}
+
+inline void shader::set(uniform<bool> uniform, const bool value) const
+{
+    // shadowed as the int GL stores, so set_bool() and set_int() on the same uniform compare the same bytes
+    set(::uniform<int>{uniform.location, uniform.shadow_slot, uniform.program, uniform.name_hash},
+        static_cast<int>(value));
+}
+
+inline void shader::set(uniform<int> uniform, const int value) const
+{
+    if (update_shadow(uniform, value))
+        glUniform1i(uniform.location, value);
+}
+
+inline void shader::set(uniform<float> uniform, const float value) const
+{
+    if (update_shadow(uniform, value))
+        glUniform1f(uniform.location, value);
+}
+
+inline void shader::set(uniform<glm::vec2> uniform, const glm::vec2 value) const
+{
+    if (update_shadow(uniform, value))
+        glUniform2f(uniform.location, value.x, value.y);
+}
+
+inline void shader::set(uniform<glm::vec3> uniform, const glm::vec3 value) const
+{
+    if (update_shadow(uniform, value))
+        glUniform3f(uniform.location, value.x, value.y, value.z);
+}
+
+inline void shader::set(uniform<glm::mat4> uniform, const glm::mat4& value) const
 {
-    glUseProgram(id);
+    if (update_shadow(uniform, value))
+        glUniformMatrix4fv(uniform.location, 1, GL_FALSE, value_ptr(value));
 }
 
-inline void shader::set_bool(const std::string& name, const bool value) const
+inline void shader::set_bool(const uniform_id name, const bool value) const
 {
-    glUniform1i(glGetUniformLocation(id, name.c_str()), static_cast<int>(value));
+    set(get_uniform<bool>(name), value);
 }
 
-inline void shader::set_int(const std::string& name, const int value) const
+inline void shader::set_int(const uniform_id name, const int value) const
 {
-    glUniform1i(glGetUniformLocation(id, name.c_str()), value);
+    set(get_uniform<int>(name), value);
 }
 
-inline void shader::set_float(const std::string& name, const float value) const
+inline void shader::set_float(const uniform_id name, const float value) const
 {
-    glUniform1f(glGetUniformLocation(id, name.c_str()), value);
+    set(get_uniform<float>(name), value);
 }
 
-inline void shader::set_mat4(const std::string& name, glm::mat4 value) const
+inline void shader::set_mat4(const uniform_id name, const glm::mat4& value) const
 {
-    glUniformMatrix4fv(glGetUniformLocation(id, name.c_str()), 1, GL_FALSE, value_ptr(value));
+    set(get_uniform<glm::mat4>(name), value);
 }
 
-inline void shader::set_vec3(const std::string& name, const float x, const float y, const float z) const
+inline void shader::set_vec3(const uniform_id name, const float x, const float y, const float z) const
 {
-    glUniform3f(glGetUniformLocation(id, name.c_str()), x, y, z);
+    set(get_uniform<glm::vec3>(name), glm::vec3(x, y, z));
 }
 
-inline void shader::set_vec3(const std::string& name, const glm::vec3 value) const
+inline void shader::set_vec3(const uniform_id name, const glm::vec3 value) const
 {
-    glUniform3f(glGetUniformLocation(id, name.c_str()), value.x, value.y, value.z);
+    set(get_uniform<glm::vec3>(name), value);
 }
 
-inline void shader::set_vec2(const std::string& name, const float x, const float y) const
+inline void shader::set_vec2(const uniform_id name, const float x, const float y) const
 {
-    glUniform2f(glGetUniformLocation(id, name.c_str()), x, y);
+    set(get_uniform<glm::vec2>(name), glm::vec2(x, y));
 }
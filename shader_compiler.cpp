@@ -0,0 +1,113 @@
+﻿#include "shader_compiler.h"
+
+#include <cstring>
+#include <iostream>
+#include <unordered_map>
+
+namespace
+{
+    using max_shader_compiler_threads_function = void (APIENTRYP)(GLuint count);
+
+    max_shader_compiler_threads_function max_shader_compiler_threads = nullptr;
+    bool parallel_compile = false;
+    shader_compile_mode compile_mode = shader_compile_mode::batch;
+    std::int64_t build_time = 0;
+    size_t program_count = 0;
+
+    std::unordered_map<std::uint64_t, unsigned int> stages;
+    size_t stages_compiled = 0;
+    size_t stages_reused = 0;
+}
+
+void shader_compiler::initialize(const GLADloadproc load)
+{
+    const char* function_name = nullptr;
+    GLint extension_count = 0;
+    glGetIntegerv(GL_NUM_EXTENSIONS, &extension_count);
+    for (GLint i = 0; i < extension_count; ++i)
+    {
+        const auto name = reinterpret_cast<const char*>(glGetStringi(GL_EXTENSIONS, i));
+        if (!name)
+            continue;
+        if (std::strcmp(name, "GL_KHR_parallel_shader_compile") == 0)
+            function_name = "glMaxShaderCompilerThreadsKHR";
+        else if (std::strcmp(name, "GL_ARB_parallel_shader_compile") == 0 && !function_name)
+            function_name = "glMaxShaderCompilerThreadsARB";
+    }
+    if (!function_name)
+        return;
+
+    max_shader_compiler_threads = reinterpret_cast<max_shader_compiler_threads_function>(load(function_name));
+    if (!max_shader_compiler_threads)
+        return;
+
+    // 0xFFFFFFFF leaves the number of threads to the implementation
+    max_shader_compiler_threads(0xFFFFFFFFu);
+    parallel_compile = true;
+}
+
+bool shader_compiler::has_parallel_compile()
+{
+    return parallel_compile;
+}
+
+void shader_compiler::set_mode(const shader_compile_mode mode)
+{
+    compile_mode = mode;
+}
+
+shader_compile_mode shader_compiler::get_mode()
+{
+    return compile_mode;
+}
+
+const char* shader_compiler::get_mode_name(const shader_compile_mode mode)
+{
+    return mode == shader_compile_mode::serial ? "serial" : "batch";
+}
+
+unsigned int shader_compiler::find_stage(const std::uint64_t key)
+{
+    const auto it = stages.find(key);
+    if (it == stages.end())
+        return 0;
+
+    stages_reused++;
+    return it->second;
+}
+
+void shader_compiler::add_stage(const std::uint64_t key, const unsigned int stage)
+{
+    stages[key] = stage;
+    stages_compiled++;
+}
+
+void shader_compiler::release_stages()
+{
+    for (const auto& [key, stage] : stages)
+        glDeleteShader(stage);
+    stages.clear();
+}
+
+void shader_compiler::add_build_time(const std::int64_t microseconds, const size_t programs_finished)
+{
+    build_time += microseconds;
+    program_count += programs_finished;
+}
+
+std::int64_t shader_compiler::get_build_time()
+{
+    return build_time;
+}
+
+size_t shader_compiler::get_program_count()
+{
+    return program_count;
+}
+
+void shader_compiler::report()
+{
+    std::cout << "SHADER::BUILD_TIME " << get_mode_name(compile_mode) << ", " << build_time / 1000.0 << " ms, "
+        << program_count << " programs, " << stages_compiled << " stages compiled, " << stages_reused
+        << " reused, parallel compile " << (parallel_compile ? "on" : "off") << std::endl;
+}
@@ -0,0 +1,44 @@
+﻿#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <glad/glad.h>
+
+enum class shader_compile_mode
+{
+    // every stage and program is checked right after it was submitted, one finishes before the next starts
+    serial,
+    // programs are submitted and checked the first time they are used, the driver compiles them meanwhile
+    batch,
+};
+
+// How shader builds programs. In batch mode the driver is given all startup programs before the first status query,
+// which is what makes it wait. With GL_KHR_parallel_shader_compile or GL_ARB_parallel_shader_compile it compiles
+// them on its own threads; without, drivers that compile asynchronously anyway still overlap the work.
+// Only to be used from the thread owning the GL context.
+class shader_compiler
+{
+public:
+    // resolves the entry points missing from the loader and lets the driver use as many compiler threads as it
+    // likes, call once after gladLoadGLLoader
+    static void initialize(GLADloadproc load);
+    static bool has_parallel_compile();
+
+    // batch by default; affects programs submitted afterwards
+    static void set_mode(shader_compile_mode mode);
+    static shader_compile_mode get_mode();
+    static const char* get_mode_name(shader_compile_mode mode);
+
+    // Compiled stage objects shared by all programs, keyed by stage type, source and defines (see
+    // shader::get_stage_key). The cache owns them: programs detach them once linked, release_stages() deletes them.
+    // 0 if the stage was not compiled yet
+    static unsigned int find_stage(std::uint64_t key);
+    static void add_stage(std::uint64_t key, unsigned int stage);
+    static void release_stages();
+
+    // wall-clock time the calling thread spent building programs, submitting and waiting for them
+    static void add_build_time(std::int64_t microseconds, size_t programs_finished);
+    static std::int64_t get_build_time();
+    static size_t get_program_count();
+    // prints SHADER::BUILD_TIME with the mode, the time, the number of programs and how many stages were shared
+    static void report();
+};
@@ -1,5 +1,10 @@
 #version 330 core
 
+// Feature keywords, defined per variant by the shader class:
+// POINT_LIGHTS - adds the point lights of the Lights block
+// SPOT_LIGHT - adds the spot light, e.g. while the flashlight is on
+// REFLECTION - mixes in the skybox, for materials with a reflectivity above 0
+
 struct Material {
     vec3 diffuse;
     vec3 specular;
@@ -41,14 +46,23 @@ in vec3 Normal;
 in vec3 FragPos;
 in vec2 TexCoords;
 
-uniform vec3 viewPos;
+layout (std140) uniform Camera
+{
+    mat4 view;
+    mat4 projection;
+    vec3 viewPos;
+};
 
 uniform Material material;
-uniform DirectionalLight light;
 
+// lights_block in frame_uniforms.h
 #define NR_POINT_LIGHTS 4
-uniform PointLight pointLights[NR_POINT_LIGHTS];
-uniform SpotLight spotLight;
+layout (std140) uniform Lights
+{
+    DirectionalLight light;
+    PointLight pointLights[NR_POINT_LIGHTS];
+    SpotLight spotLight;
+};
 
 uniform samplerCube skybox; 
 
@@ -111,19 +125,25 @@ void main()
 
     vec3 result = vec3(0.0f);
     result += calculateDirectionalLight(light, diffuseColor, specularColor, material.shininess, normal, viewDir);
-    
+
+#ifdef POINT_LIGHTS
     for (int i = 0; i < NR_POINT_LIGHTS; i++) 
     {
         result += calculatePointLight(pointLights[i], diffuseColor, specularColor, material.shininess, normal, viewDir);
     }
-    
+#endif
+
+#ifdef SPOT_LIGHT
     result += calculateSpotLight(spotLight, diffuseColor, specularColor, material.shininess, normal, viewDir);
+#endif
 
     vec3 ambient = diffuseColor * light.ambient;
     result += ambient;
 
+#ifdef REFLECTION
     vec3 r = reflect(-viewDir, normal);
     result = mix(result, vec3(texture(skybox, r)), material.reflectivity * texture(material.texture_specular1, TexCoords).r);
+#endif
 
     FragColor = vec4(result, 1);
 }
\ No newline at end of file
@@ -9,14 +9,36 @@ out vec3 FragPos;
 out vec2 TexCoords;
 
 uniform mat4 model;
-uniform mat4 view;
-uniform mat4 projection;
+
+layout (std140) uniform Camera
+{
+    mat4 view;
+    mat4 projection;
+    vec3 viewPos;
+};
+
+// compact vertices: positions are normalized to the mesh bounds and normals are octahedral encoded
+uniform vec3 positionOffset;
+uniform vec3 positionScale;
+uniform bool octahedralNormals;
+
+vec3 decodeOctahedral(vec2 encoded)
+{
+    vec3 normal = vec3(encoded, 1.0 - abs(encoded.x) - abs(encoded.y));
+    float fold = max(-normal.z, 0.0);
+    normal.x += normal.x >= 0.0 ? -fold : fold;
+    normal.y += normal.y >= 0.0 ? -fold : fold;
+    return normalize(normal);
+}
 
 void main()
 {
-    vec4 frag_pos = model * vec4(aPos, 1);
+    vec3 position = positionOffset + aPos * positionScale;
+    vec3 normal = octahedralNormals ? decodeOctahedral(aNormal.xy) : aNormal;
+
+    vec4 frag_pos = model * vec4(position, 1);
     FragPos = vec3(frag_pos);
     gl_Position = projection * view * frag_pos;
-    Normal = vec3(model * vec4(aNormal, 0));
+    Normal = vec3(model * vec4(normal, 0));
     TexCoords = aTexCoords;
 }
\ No newline at end of file
@@ -3,12 +3,17 @@ layout (location = 0) in vec3 aPos;
 
 out vec3 TexCoords;
 
-uniform mat4 projection;
-uniform mat4 view;
+layout (std140) uniform Camera
+{
+    mat4 view;
+    mat4 projection;
+    vec3 viewPos;
+};
 
 void main()
 {
     TexCoords = aPos;
-    vec4 position = projection * view * vec4(aPos, 1.0);
+    // without the translation the skybox stays around the camera
+    vec4 position = projection * mat4(mat3(view)) * vec4(aPos, 1.0);
     gl_Position = position.xyww;
 }  
\ No newline at end of file
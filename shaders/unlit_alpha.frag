@@ -3,7 +3,13 @@
 out vec4 FragColor;
 
 struct Material {
+#ifdef TEXTURE_ARRAYS
+    // the model's textures were packed, each one is a layer of a shared texture array
+    sampler2DArray texture_diffuse1;
+    int texture_diffuse1_layer;
+#else
     sampler2D texture_diffuse1;
+#endif
 };
 
 in vec3 Normal;
@@ -14,6 +20,10 @@ uniform Material material;
 
 void main()
 {
+#ifdef TEXTURE_ARRAYS
+    vec4 diffuseColor = texture(material.texture_diffuse1, vec3(TexCoords, material.texture_diffuse1_layer));
+#else
     vec4 diffuseColor = texture(material.texture_diffuse1, TexCoords);
+#endif
     FragColor = diffuseColor;
 }
\ No newline at end of file
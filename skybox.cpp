@@ -2,6 +2,7 @@
 
 void skybox::load_mesh()
 {
+    profile_scope scope("upload", "skybox");
     constexpr float skybox_vertices[] = {
         // positions          
         -1.0f, 1.0f, -1.0f,
@@ -67,13 +68,11 @@ skybox::skybox(const cubemap cubemap, const shader shader): cubemap_(cubemap), s
     load_mesh();
 }
 
-void skybox::draw(const glm::mat4x4& view, const glm::mat4x4& projection) const
+void skybox::draw() const
 {
     glDepthFunc(GL_LEQUAL);
 
     shader_.use();
-    shader_.set_mat4("view", glm::mat4(glm::mat3(view))); // remove translation to put skybox at camera's position
-    shader_.set_mat4("projection", projection);
 
     glBindVertexArray(vao_);
     cubemap_.bind();
@@ -7,7 +7,8 @@ class skybox
 public:
     explicit skybox(cubemap cubemap, shader shader);
 
-    void draw(const glm::mat4x4& view, const glm::mat4x4& projection) const;
+    // uses the view and projection of the Camera uniform block
+    void draw() const;
 
 private:
     cubemap cubemap_;
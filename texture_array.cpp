@@ -0,0 +1,305 @@
+﻿#include "texture_array.h"
+
+#include <algorithm>
+#include <iostream>
+
+#include <glad/glad.h>
+
+#include "asset_package.h"
+#include "model.h"
+#include "texture_registry.h"
+
+namespace
+{
+    GLenum get_pixel_format(const int channels)
+    {
+        switch (channels)
+        {
+        case 1:
+            return GL_RED;
+        case 2:
+            return GL_RG;
+        case 3:
+            return GL_RGB;
+        default:
+            return GL_RGBA;
+        }
+    }
+
+    // Formats GL 3.3 requires to be color-renderable, growing an array reads its layers through a framebuffer.
+    // GL_RGB8 isn't one of them, RGB textures are stored with an alpha of 1 instead, uploading RGB texels fills it.
+    GLint get_internal_format(const int channels)
+    {
+        switch (channels)
+        {
+        case 1:
+            return GL_R8;
+        case 2:
+            return GL_RG8;
+        default:
+            return GL_RGBA8;
+        }
+    }
+
+    // levels of a full chain down to 1x1, which is what generate_mip_chain() and the cooker produce
+    size_t get_full_level_count(const int width, const int height)
+    {
+        size_t level_count = 1;
+        for (int size = std::max(width, height); size > 1; size /= 2)
+            ++level_count;
+        return level_count;
+    }
+
+    bool is_packable_size(const int width, const int height, const size_t level_count)
+    {
+        return width > 0 && height > 0 && width <= texture_array_registry::max_packed_size &&
+            height <= texture_array_registry::max_packed_size && level_count == get_full_level_count(width, height);
+    }
+}
+
+unsigned int texture_array::get_id() const
+{
+    return id_;
+}
+
+unsigned int texture_array::get_layer_count() const
+{
+    return layers_used_;
+}
+
+texture_array_registry& texture_array_registry::instance()
+{
+    static texture_array_registry registry;
+    return registry;
+}
+
+bool texture_array_registry::can_pack(const image& image)
+{
+    return image.is_valid() && is_packable_size(image.width, image.height, image.mip_levels.size() + 1);
+}
+
+bool texture_array_registry::can_pack(const cooked_texture& texture)
+{
+    return texture.is_valid() && texture.format == block_format::none &&
+        is_packable_size(texture.levels[0].width, texture.levels[0].height, texture.levels.size());
+}
+
+bool texture_array_registry::contains(const std::string& filename, const model_params& params, const bool gamma) const
+{
+    return textures_by_key_.count(texture_registry::make_key(filename, params, gamma)) != 0;
+}
+
+packed_texture texture_array_registry::acquire_existing(const std::string& filename, const model_params& params,
+                                                        const bool gamma)
+{
+    const auto key = texture_registry::make_key(filename, params, gamma);
+    const auto it = textures_by_key_.find(key);
+    if (it == textures_by_key_.end())
+        return {};
+
+    return add_reference(it->second, key);
+}
+
+packed_texture texture_array_registry::acquire(const std::string& filename, const model_params& params,
+                                               const bool gamma, const image& image)
+{
+    if (!can_pack(image))
+        return {};
+
+    std::vector<level_data> levels{{image.width, image.height, image.pixels.get()}};
+    for (const auto& level : image.mip_levels)
+        levels.push_back({level.width, level.height, level.pixels.data()});
+    return acquire_levels(filename, params, gamma, image.channels, levels);
+}
+
+packed_texture texture_array_registry::acquire(const std::string& filename, const model_params& params,
+                                               const bool gamma, const cooked_texture& texture)
+{
+    if (!can_pack(texture))
+        return {};
+
+    std::vector<level_data> levels;
+    for (const auto& level : texture.levels)
+        levels.push_back({level.width, level.height, level.pixels});
+    return acquire_levels(filename, params, gamma, texture.channels, levels);
+}
+
+void texture_array_registry::release(const packed_texture& texture)
+{
+    if (!texture.is_valid())
+        return;
+
+    auto& array = *texture.array;
+    auto& layer = array.layers_[texture.layer];
+    if (layer.reference_count == 0 || --layer.reference_count > 0)
+        return;
+
+    for (const auto& key : layer.keys)
+        textures_by_key_.erase(key);
+    layer.keys.clear();
+    if (--array.layers_used_ > 0)
+        return;
+
+    glDeleteTextures(1, &array.id_);
+    std::fill(bound_ids_.begin(), bound_ids_.end(), 0u);
+    arrays_.erase(std::find_if(arrays_.begin(), arrays_.end(), [&array](const auto& candidate)
+    {
+        return candidate.get() == &array;
+    }));
+}
+
+void texture_array_registry::bind(const unsigned int unit, const texture_array& array)
+{
+    if (unit >= bound_ids_.size())
+        bound_ids_.resize(unit + 1, 0);
+    if (bound_ids_[unit] == array.id_)
+        return;
+
+    glActiveTexture(GL_TEXTURE0 + unit);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, array.id_);
+    bound_ids_[unit] = array.id_;
+}
+
+size_t texture_array_registry::get_array_count() const
+{
+    return arrays_.size();
+}
+
+packed_texture texture_array_registry::acquire_levels(const std::string& filename, const model_params& params,
+                                                      const bool gamma, const int channels,
+                                                      const std::vector<level_data>& levels)
+{
+    const auto key = texture_registry::make_key(filename, params, gamma);
+    const auto existing = textures_by_key_.find(key);
+    if (existing != textures_by_key_.end())
+        return add_reference(existing->second, key);
+
+    auto& array = find_array(levels[0].width, levels[0].height, channels, levels.size(), params.texture_clamp);
+    if (array.layers_used_ == array.layers_.size())
+        allocate(array, std::max(initial_layer_count, static_cast<unsigned int>(array.layers_.size() * 2)));
+
+    const auto free_layer = std::find_if(array.layers_.begin(), array.layers_.end(), [](const auto& layer)
+    {
+        return layer.reference_count == 0;
+    });
+    packed_texture texture;
+    texture.array = &array;
+    texture.layer = static_cast<unsigned int>(free_layer - array.layers_.begin());
+    ++array.layers_used_;
+
+    const GLenum format = get_pixel_format(channels);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, array.id_);
+    // levels are tightly packed, small RGB levels have rows that are not a multiple of 4 bytes
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    for (size_t level = 0; level < levels.size(); ++level)
+    {
+        const auto& data = levels[level];
+        glTexSubImage3D(GL_TEXTURE_2D_ARRAY, static_cast<GLint>(level), 0, 0, static_cast<GLint>(texture.layer),
+                        data.width, data.height, 1, format, GL_UNSIGNED_BYTE, data.pixels);
+    }
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+    std::fill(bound_ids_.begin(), bound_ids_.end(), 0u);
+
+    return add_reference(texture, key);
+}
+
+texture_array& texture_array_registry::find_array(const int width, const int height, const int channels,
+                                                  const size_t level_count, const bool clamp)
+{
+    for (const auto& array : arrays_)
+    {
+        if (array->width_ == width && array->height_ == height && array->channels_ == channels &&
+            array->level_count_ == level_count && array->clamp_ == clamp)
+            return *array;
+    }
+
+    auto array = std::make_unique<texture_array>();
+    array->width_ = width;
+    array->height_ = height;
+    array->channels_ = channels;
+    array->level_count_ = level_count;
+    array->clamp_ = clamp;
+    arrays_.push_back(std::move(array));
+    return *arrays_.back();
+}
+
+void texture_array_registry::allocate(texture_array& array, const unsigned int layer_count)
+{
+    unsigned int id;
+    glGenTextures(1, &id);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, id);
+
+    const GLenum format = get_pixel_format(array.channels_);
+    const GLint internal_format = get_internal_format(array.channels_);
+    int width = array.width_, height = array.height_;
+    for (size_t level = 0; level < array.level_count_; ++level)
+    {
+        glTexImage3D(GL_TEXTURE_2D_ARRAY, static_cast<GLint>(level), internal_format, width, height,
+                     static_cast<GLsizei>(layer_count), 0, format, GL_UNSIGNED_BYTE, nullptr);
+        width = std::max(1, width / 2);
+        height = std::max(1, height / 2);
+    }
+
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAX_LEVEL, static_cast<GLint>(array.level_count_ - 1));
+    const auto wrap_mode = array.clamp_ ? GL_CLAMP_TO_EDGE : GL_REPEAT;
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, wrap_mode);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, wrap_mode);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+
+    if (array.id_ != 0)
+    {
+        // GL 3.3 has no glCopyImageSubData, copy every layer and level through a read framebuffer instead
+        GLint previous_framebuffer;
+        glGetIntegerv(GL_READ_FRAMEBUFFER_BINDING, &previous_framebuffer);
+        unsigned int framebuffer;
+        glGenFramebuffers(1, &framebuffer);
+        glBindFramebuffer(GL_READ_FRAMEBUFFER, framebuffer);
+
+        width = array.width_;
+        height = array.height_;
+        for (size_t level = 0; level < array.level_count_; ++level)
+        {
+            for (size_t layer = 0; layer < array.layers_.size(); ++layer)
+            {
+                if (array.layers_[layer].reference_count == 0)
+                    continue;
+                glFramebufferTextureLayer(GL_READ_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, array.id_,
+                                          static_cast<GLint>(level), static_cast<GLint>(layer));
+                if (glCheckFramebufferStatus(GL_READ_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+                {
+                    std::cout << "ERROR::TEXTURE_ARRAY::LAYER_NOT_COPIED " << array.width_ << "x" << array.height_ <<
+                        "x" << array.channels_ << " layer " << layer << " level " << level << std::endl;
+                    continue;
+                }
+                glCopyTexSubImage3D(GL_TEXTURE_2D_ARRAY, static_cast<GLint>(level), 0, 0, static_cast<GLint>(layer),
+                                    0, 0, width, height);
+            }
+            width = std::max(1, width / 2);
+            height = std::max(1, height / 2);
+        }
+
+        glBindFramebuffer(GL_READ_FRAMEBUFFER, static_cast<GLuint>(previous_framebuffer));
+        glDeleteFramebuffers(1, &framebuffer);
+        glDeleteTextures(1, &array.id_);
+        std::cout << "TEXTURE_ARRAY::GROWN " << array.width_ << "x" << array.height_ << "x" << array.channels_ <<
+            " to " << layer_count << " layers" << std::endl;
+    }
+
+    glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+    std::fill(bound_ids_.begin(), bound_ids_.end(), 0u);
+    array.id_ = id;
+    array.layers_.resize(layer_count);
+}
+
+packed_texture texture_array_registry::add_reference(const packed_texture& texture, const std::string& key)
+{
+    auto& layer = texture.array->layers_[texture.layer];
+    ++layer.reference_count;
+
+    if (textures_by_key_.emplace(key, texture).second)
+        layer.keys.push_back(key);
+
+    return texture;
+}
@@ -0,0 +1,105 @@
+﻿#pragma once
+#include <cstddef>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "image.h"
+
+struct cooked_texture;
+struct model_params;
+
+// One GL_TEXTURE_2D_ARRAY holding textures of the same size, format, mip count and wrap mode, one per layer.
+// The GL name changes when the array grows, always bind it through get_id().
+class texture_array
+{
+public:
+    unsigned int get_id() const;
+    unsigned int get_layer_count() const;
+
+private:
+    friend class texture_array_registry;
+
+    struct layer
+    {
+        size_t reference_count = 0;
+        std::vector<std::string> keys;
+    };
+
+    unsigned int id_ = 0;
+    int width_ = 0;
+    int height_ = 0;
+    int channels_ = 0;
+    size_t level_count_ = 0;
+    bool clamp_ = false;
+    // allocated layers, in use or free
+    std::vector<layer> layers_;
+    unsigned int layers_used_ = 0;
+};
+
+// A texture as placed by texture_array_registry, invalid if it was not packed
+struct packed_texture
+{
+    texture_array* array = nullptr;
+    unsigned int layer = 0;
+
+    bool is_valid() const
+    {
+        return array != nullptr;
+    }
+};
+
+// Packs small textures of models loaded with model_params::pack_textures into shared texture arrays, so props with
+// different textures can be drawn one after the other, or batched, without rebinding. Arrays start small and double
+// when full; the layers are copied over on the GPU. Shaders sample these textures as sampler2DArray, with the layer
+// in the "<sampler name>_layer" uniform. Only to be used from the thread owning the GL context.
+class texture_array_registry
+{
+public:
+    // larger textures stay plain GL_TEXTURE_2D, the arrays are meant for small props
+    static constexpr int max_packed_size = 512;
+    static constexpr unsigned int initial_layer_count = 2;
+
+    static texture_array_registry& instance();
+
+    // uncompressed, at most max_packed_size on each side, with the full mip chain
+    static bool can_pack(const image& image);
+    static bool can_pack(const cooked_texture& texture);
+
+    // gamma as for texture_registry, whose keys these are
+    bool contains(const std::string& filename, const model_params& params, bool gamma) const;
+    packed_texture acquire_existing(const std::string& filename, const model_params& params, bool gamma);
+    // uploads the texture into a free layer of a compatible array, which is created or grown as needed
+    packed_texture acquire(const std::string& filename, const model_params& params, bool gamma, const image& image);
+    packed_texture acquire(const std::string& filename, const model_params& params, bool gamma,
+                           const cooked_texture& texture);
+    // frees the layer once the last reference is gone, and the array once it is empty
+    void release(const packed_texture& texture);
+
+    // binds the array to the texture unit unless it is still bound there from an earlier call
+    void bind(unsigned int unit, const texture_array& array);
+
+    size_t get_array_count() const;
+
+private:
+    struct level_data
+    {
+        int width;
+        int height;
+        const unsigned char* pixels;
+    };
+
+    std::vector<std::unique_ptr<texture_array>> arrays_;
+    std::unordered_map<std::string, packed_texture> textures_by_key_;
+    // array bound to each texture unit through bind(), cleared whenever an array is reallocated or deleted
+    std::vector<unsigned int> bound_ids_;
+
+    texture_array_registry() = default;
+
+    packed_texture acquire_levels(const std::string& filename, const model_params& params, bool gamma, int channels,
+                                  const std::vector<level_data>& levels);
+    texture_array& find_array(int width, int height, int channels, size_t level_count, bool clamp);
+    void allocate(texture_array& array, unsigned int layer_count);
+    packed_texture add_reference(const packed_texture& texture, const std::string& key);
+};
@@ -0,0 +1,639 @@
+﻿#include "texture_compression.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <limits>
+#include <glad/glad.h>
+
+#include "asset_package.h"
+#include "profiler.h"
+#include "thread_pool.h"
+
+namespace
+{
+    // extension enums, not part of the core 3.3 headers
+    constexpr GLenum compressed_rgba_s3tc_dxt1 = 0x83F1;
+    constexpr GLenum compressed_rgba_s3tc_dxt5 = 0x83F3;
+    constexpr GLenum compressed_rg_rgtc2 = 0x8DBD;
+    constexpr GLenum compressed_rgba_bptc_unorm = 0x8E8C;
+
+    constexpr int block_texel_count = 16;
+    // levels with fewer blocks than this are not worth handing to other threads
+    constexpr size_t min_parallel_block_count = 64 * 64;
+
+    using block_texels = unsigned char[block_texel_count][4];
+
+    int get_block_count(const int size)
+    {
+        return (size + 3) / 4;
+    }
+
+    // The 4x4 texels of a block as RGBA, single channels are replicated to gray. Texels past the edge of the level
+    // repeat the last row and column.
+    void load_block(const unsigned char* pixels, const int width, const int height, const int channels,
+                    const int block_x, const int block_y, block_texels& texels)
+    {
+        for (int y = 0; y < 4; ++y)
+        {
+            const int source_y = std::min(block_y * 4 + y, height - 1);
+            for (int x = 0; x < 4; ++x)
+            {
+                const int source_x = std::min(block_x * 4 + x, width - 1);
+                const auto source = pixels + (static_cast<size_t>(source_y) * width + source_x) * channels;
+                auto& texel = texels[y * 4 + x];
+                if (channels == 1)
+                {
+                    texel[0] = texel[1] = texel[2] = source[0];
+                    texel[3] = 255;
+                }
+                else if (channels == 2)
+                {
+                    texel[0] = source[0];
+                    texel[1] = source[1];
+                    texel[2] = 0;
+                    texel[3] = 255;
+                }
+                else
+                {
+                    texel[0] = source[0];
+                    texel[1] = source[1];
+                    texel[2] = source[2];
+                    texel[3] = channels == 4 ? source[3] : 255;
+                }
+            }
+        }
+    }
+
+    void store_block(const block_texels& texels, const int width, const int height, const int channels,
+                     const int block_x, const int block_y, unsigned char* pixels)
+    {
+        for (int y = 0; y < 4 && block_y * 4 + y < height; ++y)
+        {
+            for (int x = 0; x < 4 && block_x * 4 + x < width; ++x)
+            {
+                const auto target = pixels + (static_cast<size_t>(block_y * 4 + y) * width + block_x * 4 + x) *
+                    channels;
+                std::memcpy(target, texels[y * 4 + x], channels);
+            }
+        }
+    }
+
+    std::uint16_t pack_565(const float color[3])
+    {
+        const auto quantize = [](const float value, const int max)
+        {
+            return std::min(std::max(static_cast<int>(value * max / 255.0f + 0.5f), 0), max);
+        };
+        return static_cast<std::uint16_t>(quantize(color[0], 31) << 11 | quantize(color[1], 63) << 5 |
+            quantize(color[2], 31));
+    }
+
+    void unpack_565(const std::uint16_t packed, int color[3])
+    {
+        const int r = packed >> 11 & 31;
+        const int g = packed >> 5 & 63;
+        const int b = packed & 31;
+        color[0] = r << 3 | r >> 2;
+        color[1] = g << 2 | g >> 4;
+        color[2] = b << 3 | b >> 2;
+    }
+
+    // Colors of a BC1 block in index order. Blocks with c0 <= c1 have a single midpoint and transparent black,
+    // except in BC3 where the color block always has four colors.
+    void make_color_palette(const std::uint16_t c0, const std::uint16_t c1, const bool four_colors, int palette[4][4])
+    {
+        unpack_565(c0, palette[0]);
+        unpack_565(c1, palette[1]);
+        palette[0][3] = palette[1][3] = 255;
+        if (four_colors || c0 > c1)
+        {
+            for (int i = 0; i < 3; ++i)
+            {
+                palette[2][i] = (2 * palette[0][i] + palette[1][i]) / 3;
+                palette[3][i] = (palette[0][i] + 2 * palette[1][i]) / 3;
+            }
+            palette[2][3] = palette[3][3] = 255;
+        }
+        else
+        {
+            for (int i = 0; i < 3; ++i)
+            {
+                palette[2][i] = (palette[0][i] + palette[1][i]) / 2;
+                palette[3][i] = 0;
+            }
+            palette[2][3] = 255;
+            palette[3][3] = 0;
+        }
+    }
+
+    struct color_fit
+    {
+        std::uint16_t c0;
+        std::uint16_t c1;
+        unsigned char indices[block_texel_count];
+        int error;
+    };
+
+    // Orders the endpoints for four colors and picks the closest color for every texel. Equal endpoints leave
+    // the block in three color mode, which is harmless as every index then points at c0.
+    color_fit fit_indices(const block_texels& texels, std::uint16_t c0, std::uint16_t c1)
+    {
+        if (c0 < c1)
+            std::swap(c0, c1);
+
+        int palette[4][4];
+        make_color_palette(c0, c1, true, palette);
+
+        color_fit fit{c0, c1, {}, 0};
+        for (int i = 0; i < block_texel_count; ++i)
+        {
+            int best_error = std::numeric_limits<int>::max();
+            for (unsigned char index = 0; index < (c0 == c1 ? 1 : 4); ++index)
+            {
+                int error = 0;
+                for (int channel = 0; channel < 3; ++channel)
+                {
+                    const int difference = texels[i][channel] - palette[index][channel];
+                    error += difference * difference;
+                }
+                if (error < best_error)
+                {
+                    best_error = error;
+                    fit.indices[i] = index;
+                }
+            }
+            fit.error += best_error;
+        }
+        return fit;
+    }
+
+    // Endpoints along the principal axis of the block's colors, then one least squares refit of the endpoints to
+    // the chosen indices.
+    void encode_color_block(const block_texels& texels, unsigned char* block)
+    {
+        float mean[3] = {};
+        float min[3] = {255.0f, 255.0f, 255.0f};
+        float max[3] = {};
+        for (const auto& texel : texels)
+        {
+            for (int i = 0; i < 3; ++i)
+            {
+                mean[i] += texel[i];
+                min[i] = std::min(min[i], static_cast<float>(texel[i]));
+                max[i] = std::max(max[i], static_cast<float>(texel[i]));
+            }
+        }
+        for (auto& value : mean)
+            value /= block_texel_count;
+
+        // covariance as xx, xy, xz, yy, yz, zz
+        float covariance[6] = {};
+        for (const auto& texel : texels)
+        {
+            const float r = texel[0] - mean[0], g = texel[1] - mean[1], b = texel[2] - mean[2];
+            covariance[0] += r * r;
+            covariance[1] += r * g;
+            covariance[2] += r * b;
+            covariance[3] += g * g;
+            covariance[4] += g * b;
+            covariance[5] += b * b;
+        }
+
+        // power iteration, starting from the diagonal of the bounding box
+        float axis[3] = {max[0] - min[0], max[1] - min[1], max[2] - min[2]};
+        for (int iteration = 0; iteration < 8; ++iteration)
+        {
+            const float next[3] = {
+                covariance[0] * axis[0] + covariance[1] * axis[1] + covariance[2] * axis[2],
+                covariance[1] * axis[0] + covariance[3] * axis[1] + covariance[4] * axis[2],
+                covariance[2] * axis[0] + covariance[4] * axis[1] + covariance[5] * axis[2]
+            };
+            const float scale = std::max(std::max(std::abs(next[0]), std::abs(next[1])), std::abs(next[2]));
+            if (scale <= 0.0f)
+                break;
+            for (int i = 0; i < 3; ++i)
+                axis[i] = next[i] / scale;
+        }
+        const float length_squared = axis[0] * axis[0] + axis[1] * axis[1] + axis[2] * axis[2];
+
+        float endpoints[2][3] = {{mean[0], mean[1], mean[2]}, {mean[0], mean[1], mean[2]}};
+        if (length_squared > 0.0f)
+        {
+            float min_t = std::numeric_limits<float>::max();
+            float max_t = -std::numeric_limits<float>::max();
+            for (const auto& texel : texels)
+            {
+                const float t = ((texel[0] - mean[0]) * axis[0] + (texel[1] - mean[1]) * axis[1] +
+                    (texel[2] - mean[2]) * axis[2]) / length_squared;
+                min_t = std::min(min_t, t);
+                max_t = std::max(max_t, t);
+            }
+
+            // inset by 1/16 of the range, the extremes are rarely worth a whole palette entry
+            const float inset = (max_t - min_t) / 16.0f;
+            for (int i = 0; i < 3; ++i)
+            {
+                endpoints[0][i] = mean[i] + axis[i] * (max_t - inset);
+                endpoints[1][i] = mean[i] + axis[i] * (min_t + inset);
+            }
+        }
+
+        auto best = fit_indices(texels, pack_565(endpoints[0]), pack_565(endpoints[1]));
+        if (best.c0 != best.c1)
+        {
+            // weight of c0 for each index
+            constexpr float weights[4] = {1.0f, 0.0f, 2.0f / 3.0f, 1.0f / 3.0f};
+            float aa = 0.0f, ab = 0.0f, bb = 0.0f;
+            float ax[3] = {}, bx[3] = {};
+            for (int i = 0; i < block_texel_count; ++i)
+            {
+                const float a = weights[best.indices[i]];
+                const float b = 1.0f - a;
+                aa += a * a;
+                ab += a * b;
+                bb += b * b;
+                for (int channel = 0; channel < 3; ++channel)
+                {
+                    ax[channel] += a * texels[i][channel];
+                    bx[channel] += b * texels[i][channel];
+                }
+            }
+
+            const float determinant = aa * bb - ab * ab;
+            if (std::abs(determinant) > 1e-6f)
+            {
+                float refit[2][3];
+                for (int channel = 0; channel < 3; ++channel)
+                {
+                    refit[0][channel] = (bb * ax[channel] - ab * bx[channel]) / determinant;
+                    refit[1][channel] = (aa * bx[channel] - ab * ax[channel]) / determinant;
+                }
+                const auto candidate = fit_indices(texels, pack_565(refit[0]), pack_565(refit[1]));
+                if (candidate.error < best.error)
+                    best = candidate;
+            }
+        }
+
+        std::uint32_t packed_indices = 0;
+        for (int i = 0; i < block_texel_count; ++i)
+            packed_indices |= static_cast<std::uint32_t>(best.indices[i]) << (2 * i);
+
+        block[0] = static_cast<unsigned char>(best.c0 & 0xFF);
+        block[1] = static_cast<unsigned char>(best.c0 >> 8);
+        block[2] = static_cast<unsigned char>(best.c1 & 0xFF);
+        block[3] = static_cast<unsigned char>(best.c1 >> 8);
+        for (int i = 0; i < 4; ++i)
+            block[4 + i] = static_cast<unsigned char>(packed_indices >> (8 * i));
+    }
+
+    void decode_color_block(const unsigned char* block, const bool four_colors, block_texels& texels)
+    {
+        const auto c0 = static_cast<std::uint16_t>(block[0] | block[1] << 8);
+        const auto c1 = static_cast<std::uint16_t>(block[2] | block[3] << 8);
+        int palette[4][4];
+        make_color_palette(c0, c1, four_colors, palette);
+
+        const std::uint32_t indices = block[4] | block[5] << 8 | block[6] << 16 | static_cast<std::uint32_t>(block[7])
+            << 24;
+        for (int i = 0; i < block_texel_count; ++i)
+        {
+            const auto& color = palette[indices >> (2 * i) & 3];
+            for (int channel = 0; channel < 4; ++channel)
+                texels[i][channel] = static_cast<unsigned char>(color[channel]);
+        }
+    }
+
+    // The values of a BC4 block in index order: eight interpolated values for a0 > a1, otherwise six plus 0 and 255.
+    void make_value_palette(const int a0, const int a1, int palette[8])
+    {
+        palette[0] = a0;
+        palette[1] = a1;
+        if (a0 > a1)
+        {
+            for (int i = 1; i < 7; ++i)
+                palette[i + 1] = ((7 - i) * a0 + i * a1) / 7;
+        }
+        else
+        {
+            for (int i = 1; i < 5; ++i)
+                palette[i + 1] = ((5 - i) * a0 + i * a1) / 5;
+            palette[6] = 0;
+            palette[7] = 255;
+        }
+    }
+
+    // one channel of the block into a BC4 block, used for BC3 alpha and both BC5 channels
+    void encode_value_block(const block_texels& texels, const int channel, unsigned char* block)
+    {
+        int min = 255, max = 0;
+        for (const auto& texel : texels)
+        {
+            min = std::min(min, static_cast<int>(texel[channel]));
+            max = std::max(max, static_cast<int>(texel[channel]));
+        }
+
+        block[0] = static_cast<unsigned char>(max);
+        block[1] = static_cast<unsigned char>(min);
+        std::uint64_t packed_indices = 0;
+        if (max != min)
+        {
+            int palette[8];
+            make_value_palette(max, min, palette);
+            for (int i = 0; i < block_texel_count; ++i)
+            {
+                std::uint64_t best_index = 0;
+                int best_error = std::numeric_limits<int>::max();
+                for (std::uint64_t index = 0; index < 8; ++index)
+                {
+                    const int error = std::abs(texels[i][channel] - palette[index]);
+                    if (error < best_error)
+                    {
+                        best_error = error;
+                        best_index = index;
+                    }
+                }
+                packed_indices |= best_index << (3 * i);
+            }
+        }
+
+        for (int i = 0; i < 6; ++i)
+            block[2 + i] = static_cast<unsigned char>(packed_indices >> (8 * i));
+    }
+
+    void decode_value_block(const unsigned char* block, const int channel, block_texels& texels)
+    {
+        int palette[8];
+        make_value_palette(block[0], block[1], palette);
+
+        std::uint64_t indices = 0;
+        for (int i = 0; i < 6; ++i)
+            indices |= static_cast<std::uint64_t>(block[2 + i]) << (8 * i);
+        for (int i = 0; i < block_texel_count; ++i)
+            texels[i][channel] = static_cast<unsigned char>(palette[indices >> (3 * i) & 7]);
+    }
+
+    void encode_block(const block_texels& texels, const block_format format, unsigned char* block)
+    {
+        if (format == block_format::bc1)
+        {
+            encode_color_block(texels, block);
+        }
+        else if (format == block_format::bc3)
+        {
+            encode_value_block(texels, 3, block);
+            encode_color_block(texels, block + 8);
+        }
+        else if (format == block_format::bc5)
+        {
+            encode_value_block(texels, 0, block);
+            encode_value_block(texels, 1, block + 8);
+        }
+    }
+
+    void decode_block(const unsigned char* block, const block_format format, block_texels& texels)
+    {
+        if (format == block_format::bc1)
+        {
+            decode_color_block(block, false, texels);
+        }
+        else if (format == block_format::bc3)
+        {
+            decode_color_block(block + 8, true, texels);
+            decode_value_block(block, 3, texels);
+        }
+        else if (format == block_format::bc5)
+        {
+            decode_value_block(block, 0, texels);
+            decode_value_block(block + 8, 1, texels);
+            for (auto& texel : texels)
+            {
+                texel[2] = 0;
+                texel[3] = 255;
+            }
+        }
+    }
+
+    // Calls body(block_y) for every row of blocks of a level, spread across the shared pool for large levels.
+    template <typename F>
+    void for_each_block_row(const int width, const int height, const F& body)
+    {
+        const auto block_rows = static_cast<size_t>(get_block_count(height));
+        const auto run_rows = [&](const size_t begin, const size_t end)
+        {
+            for (size_t block_y = begin; block_y < end; ++block_y)
+                body(static_cast<int>(block_y));
+        };
+
+        if (block_rows * get_block_count(width) < min_parallel_block_count)
+            run_rows(0, block_rows);
+        else
+            thread_pool::shared().parallel_for(block_rows, run_rows);
+    }
+
+    compressed_level compress_level(const unsigned char* pixels, const int width, const int height,
+                                    const int channels, const block_format format)
+    {
+        compressed_level level{width, height, std::vector<unsigned char>(get_compressed_size(format, width, height))};
+        const int blocks_x = get_block_count(width);
+        const size_t block_size = get_block_size(format);
+        for_each_block_row(width, height, [&](const int block_y)
+        {
+            block_texels texels;
+            for (int block_x = 0; block_x < blocks_x; ++block_x)
+            {
+                load_block(pixels, width, height, channels, block_x, block_y, texels);
+                encode_block(texels, format, level.blocks.data() + (static_cast<size_t>(block_y) * blocks_x + block_x) *
+                             block_size);
+            }
+        });
+        return level;
+    }
+
+    void decompress_level(const unsigned char* blocks, const int width, const int height, const int channels,
+                          const block_format format, unsigned char* pixels)
+    {
+        const int blocks_x = get_block_count(width);
+        const size_t block_size = get_block_size(format);
+        for_each_block_row(width, height, [&](const int block_y)
+        {
+            block_texels texels;
+            for (int block_x = 0; block_x < blocks_x; ++block_x)
+            {
+                decode_block(blocks + (static_cast<size_t>(block_y) * blocks_x + block_x) * block_size, format,
+                             texels);
+                // gray was replicated into all color channels, so the first `channels` bytes are the texel
+                store_block(texels, width, height, channels, block_x, block_y, pixels);
+            }
+        });
+    }
+
+    struct format_support
+    {
+        bool s3tc = false;
+        bool bptc = false;
+    };
+
+    const format_support& get_format_support()
+    {
+        static const format_support support = []
+        {
+            format_support result;
+            GLint major = 0, minor = 0, extension_count = 0;
+            glGetIntegerv(GL_MAJOR_VERSION, &major);
+            glGetIntegerv(GL_MINOR_VERSION, &minor);
+            glGetIntegerv(GL_NUM_EXTENSIONS, &extension_count);
+            result.bptc = major > 4 || (major == 4 && minor >= 2);
+            for (GLint i = 0; i < extension_count; ++i)
+            {
+                const auto name = reinterpret_cast<const char*>(glGetStringi(GL_EXTENSIONS, i));
+                if (!name)
+                    continue;
+                if (std::strcmp(name, "GL_EXT_texture_compression_s3tc") == 0)
+                    result.s3tc = true;
+                else if (std::strcmp(name, "GL_ARB_texture_compression_bptc") == 0)
+                    result.bptc = true;
+            }
+            return result;
+        }();
+        return support;
+    }
+}
+
+bool compressed_image::is_valid() const
+{
+    return !levels.empty();
+}
+
+size_t get_block_size(const block_format format)
+{
+    switch (format)
+    {
+    case block_format::bc1:
+        return 8;
+    case block_format::bc3:
+    case block_format::bc5:
+    case block_format::bc7:
+        return 16;
+    default:
+        return 0;
+    }
+}
+
+size_t get_compressed_size(const block_format format, const int width, const int height)
+{
+    return static_cast<size_t>(get_block_count(width)) * get_block_count(height) * get_block_size(format);
+}
+
+block_format choose_block_format(const image& image)
+{
+    if (image.channels == 2)
+        return block_format::bc5;
+
+    if (image.channels == 4)
+    {
+        const size_t texel_count = static_cast<size_t>(image.width) * image.height;
+        for (size_t i = 0; i < texel_count; ++i)
+        {
+            if (image.pixels.get()[i * 4 + 3] != 255)
+                return block_format::bc3;
+        }
+    }
+
+    return block_format::bc1;
+}
+
+compressed_image compress_image(const image& image, const block_format format)
+{
+    profile_scope scope("compress");
+    compressed_image result;
+    if (!image.is_valid() || format == block_format::none || format == block_format::bc7)
+        return result;
+
+    result.width = image.width;
+    result.height = image.height;
+    result.channels = image.channels;
+    result.format = format;
+    result.content_hash = image.content_hash;
+    result.levels.push_back(compress_level(image.pixels.get(), image.width, image.height, image.channels, format));
+    for (const auto& level : image.mip_levels)
+        result.levels.push_back(compress_level(level.pixels.data(), level.width, level.height, image.channels, format));
+    return result;
+}
+
+image decompress_texture(const cooked_texture& texture)
+{
+    image result;
+    if (!texture.is_valid() || texture.channels < 1 || texture.channels > 4 ||
+        texture.format == block_format::none || texture.format == block_format::bc7)
+        return result;
+
+    for (const auto& level : texture.levels)
+    {
+        if (level.size < get_compressed_size(texture.format, level.width, level.height))
+            return result;
+    }
+
+    const auto& base = texture.levels[0];
+    result.pixels = {
+        static_cast<unsigned char*>(std::malloc(static_cast<size_t>(base.width) * base.height * texture.channels)),
+        std::free
+    };
+    if (!result.pixels)
+        return result;
+    decompress_level(base.pixels, base.width, base.height, texture.channels, texture.format, result.pixels.get());
+
+    for (size_t i = 1; i < texture.levels.size(); ++i)
+    {
+        const auto& level = texture.levels[i];
+        mip_level decompressed{
+            level.width, level.height,
+            std::vector<unsigned char>(static_cast<size_t>(level.width) * level.height * texture.channels)
+        };
+        decompress_level(level.pixels, level.width, level.height, texture.channels, texture.format,
+                         decompressed.pixels.data());
+        result.mip_levels.push_back(std::move(decompressed));
+    }
+
+    result.width = base.width;
+    result.height = base.height;
+    result.channels = texture.channels;
+    result.content_hash = texture.content_hash;
+    return result;
+}
+
+bool is_block_format_supported(const block_format format)
+{
+    switch (format)
+    {
+    case block_format::bc1:
+    case block_format::bc3:
+        return get_format_support().s3tc;
+    case block_format::bc5:
+        // RGTC is core since 3.0
+        return true;
+    case block_format::bc7:
+        return get_format_support().bptc;
+    default:
+        return false;
+    }
+}
+
+unsigned int get_gl_internal_format(const block_format format)
+{
+    switch (format)
+    {
+    case block_format::bc1:
+        // the RGBA variant decodes three color blocks with transparent black, for DDS files that use them
+        return compressed_rgba_s3tc_dxt1;
+    case block_format::bc3:
+        return compressed_rgba_s3tc_dxt5;
+    case block_format::bc5:
+        return compressed_rg_rgtc2;
+    case block_format::bc7:
+        return compressed_rgba_bptc_unorm;
+    default:
+        return 0;
+    }
+}
@@ -0,0 +1,63 @@
+﻿#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "image.h"
+
+struct cooked_texture;
+
+// GPU block compression formats. Every format stores 4x4 texel blocks, levels smaller than a block are padded.
+//   bc1: RGB at 4 bits per texel (DXT1), used for 1 and 3 channel images and opaque RGBA
+//   bc3: RGBA at 8 bits per texel (DXT5), BC1 color plus an interpolated alpha block
+//   bc5: two channels at 8 bits per texel (RGTC2), two BC4 blocks for red and green
+//   bc7: RGBA at 8 bits per texel, only loaded from DDS files, there is no encoder or decoder for it
+enum class block_format : std::uint32_t
+{
+    none = 0,
+    bc1,
+    bc3,
+    bc5,
+    bc7
+};
+
+struct compressed_level
+{
+    int width;
+    int height;
+    std::vector<unsigned char> blocks;
+};
+
+// Block compressed copy of an image and its mip levels, level 0 first.
+struct compressed_image
+{
+    int width = 0;
+    int height = 0;
+    // channel count of the source image, the decoder restores it
+    int channels = 0;
+    block_format format = block_format::none;
+    std::uint64_t content_hash = 0;
+    std::vector<compressed_level> levels;
+
+    bool is_valid() const;
+};
+
+size_t get_block_size(block_format format);
+// bytes of one level, 0 for block_format::none
+size_t get_compressed_size(block_format format, int width, int height);
+
+// bc5 for two channels, bc3 for RGBA with any alpha below 255, bc1 for everything else
+block_format choose_block_format(const image& image);
+
+// Encodes the image and every level in image.mip_levels. Rows of blocks are split across thread_pool::shared()
+// unless this already runs on one of its workers. Returns an invalid result for an invalid image or bc7.
+compressed_image compress_image(const image& image, block_format format);
+
+// CPU fallback for drivers without the format: decodes a block compressed texture into an 8-bit image with its
+// mip levels, with the channel count recorded in the texture. Returns an invalid image for bc7.
+image decompress_texture(const cooked_texture& texture);
+
+// Whether the current GL context can sample the format; needs a current context on the first call.
+bool is_block_format_supported(block_format format);
+// the GL internal format to pass to glCompressedTexImage2D
+unsigned int get_gl_internal_format(block_format format);
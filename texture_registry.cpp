@@ -0,0 +1,134 @@
+﻿#include "texture_registry.h"
+
+#include <filesystem>
+
+#include "asset_package.h"
+#include "hash.h"
+#include "model.h"
+
+texture_registry& texture_registry::instance()
+{
+    static texture_registry registry;
+    return registry;
+}
+
+bool texture_registry::contains(const std::string& filename, const model_params& params, const bool gamma) const
+{
+    return ids_by_key_.count(make_key(filename, params, gamma)) != 0;
+}
+
+unsigned int texture_registry::acquire_existing(const std::string& filename, const model_params& params,
+                                                const bool gamma)
+{
+    const auto key = make_key(filename, params, gamma);
+    const auto it = ids_by_key_.find(key);
+    if (it == ids_by_key_.end())
+        return 0;
+
+    return add_reference(it->second, key);
+}
+
+template <typename Upload>
+unsigned int texture_registry::acquire_content(const std::string& filename, const model_params& params,
+                                               const bool gamma, const std::uint64_t content_hash, Upload upload)
+{
+    const auto key = make_key(filename, params, gamma);
+    const auto existing = ids_by_key_.find(key);
+    if (existing != ids_by_key_.end())
+        return add_reference(existing->second, key);
+
+    const auto content_key = make_content_key(content_hash, params, gamma);
+    if (content_key != 0)
+    {
+        const auto same_content = ids_by_content_.find(content_key);
+        if (same_content != ids_by_content_.end())
+            return add_reference(same_content->second, key);
+    }
+
+    const unsigned int texture_id = upload();
+    entries_[texture_id] = {0, content_key, {}};
+    if (content_key != 0)
+        ids_by_content_[content_key] = texture_id;
+
+    return add_reference(texture_id, key);
+}
+
+unsigned int texture_registry::acquire(const std::string& filename, const model_params& params, const bool gamma,
+                                       const image& image)
+{
+    return acquire_content(filename, params, gamma, image.is_valid() ? image.content_hash : 0, [&]
+    {
+        return upload_texture(image, params, gamma);
+    });
+}
+
+unsigned int texture_registry::acquire(const std::string& filename, const model_params& params, const bool gamma,
+                                       const cooked_texture& texture)
+{
+    return acquire_content(filename, params, gamma, texture.is_valid() ? texture.content_hash : 0, [&]
+    {
+        return upload_texture(texture, params, gamma);
+    });
+}
+
+void texture_registry::release(const unsigned int texture_id)
+{
+    const auto it = entries_.find(texture_id);
+    if (it == entries_.end())
+        return;
+
+    auto& entry = it->second;
+    if (--entry.reference_count > 0)
+        return;
+
+    for (const auto& key : entry.keys)
+        ids_by_key_.erase(key);
+    if (entry.content_key != 0)
+        ids_by_content_.erase(entry.content_key);
+    entries_.erase(it);
+
+    glDeleteTextures(1, &texture_id);
+}
+
+size_t texture_registry::get_texture_count() const
+{
+    return entries_.size();
+}
+
+std::string texture_registry::make_key(const std::string& filename, const model_params& params, const bool gamma)
+{
+    std::error_code error;
+    auto path = std::filesystem::weakly_canonical(filename, error).generic_string();
+    if (error)
+        path = filename;
+
+    path += params.texture_clamp ? "|clamp" : "|repeat";
+    path += params.texture_flip ? "|flip" : "";
+    // the mip levels differ, and cooked packages hold the texture block compressed
+    path += gamma ? "|srgb" : "|linear";
+    path += params.compress_textures ? "|compressed" : "";
+    return path;
+}
+
+std::uint64_t texture_registry::make_content_key(const std::uint64_t content_hash, const model_params& params,
+                                                 const bool gamma)
+{
+    if (content_hash == 0)
+        return 0;
+
+    // the flip is already part of the content hash; the sampler state, the mip levels and the compression are not
+    std::uint64_t key = hash_value(params.texture_clamp, content_hash);
+    key = hash_value(gamma, key);
+    return hash_value(params.compress_textures, key);
+}
+
+unsigned int texture_registry::add_reference(const unsigned int texture_id, const std::string& key)
+{
+    auto& entry = entries_[texture_id];
+    ++entry.reference_count;
+
+    if (ids_by_key_.emplace(key, texture_id).second)
+        entry.keys.push_back(key);
+
+    return texture_id;
+}
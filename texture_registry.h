@@ -0,0 +1,56 @@
+﻿#pragma once
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "image.h"
+
+struct cooked_texture;
+struct model_params;
+
+// Process-wide, reference-counted set of GL textures loaded from files. Textures are shared by path and, after
+// decoding, by content, so the same image used by several models (or under several names) is uploaded once.
+// Only to be used from the thread owning the GL context.
+class texture_registry
+{
+public:
+    static texture_registry& instance();
+
+    // gamma tells a color texture, whose mip levels are averaged in linear space, from data such as normals; the same
+    // file loaded both ways gets two textures
+    bool contains(const std::string& filename, const model_params& params, bool gamma) const;
+    // takes a reference to an already registered texture, returns 0 if the file has not been loaded yet
+    unsigned int acquire_existing(const std::string& filename, const model_params& params, bool gamma);
+    // registers a freshly decoded image, uploading it unless a texture with the same content already exists
+    unsigned int acquire(const std::string& filename, const model_params& params, bool gamma, const image& image);
+    // same for a texture read from an asset package, which brings its own mip levels
+    unsigned int acquire(const std::string& filename, const model_params& params, bool gamma,
+                         const cooked_texture& texture);
+    // deletes the texture once the last reference is gone
+    void release(unsigned int texture_id);
+
+    size_t get_texture_count() const;
+
+    // identifies a file loaded with the sampler state, flip and compression of the params, shared with
+    // texture_array_registry
+    static std::string make_key(const std::string& filename, const model_params& params, bool gamma);
+
+private:
+    struct entry
+    {
+        size_t reference_count;
+        std::uint64_t content_key;
+        std::vector<std::string> keys;
+    };
+
+    std::unordered_map<std::string, unsigned int> ids_by_key_;
+    std::unordered_map<std::uint64_t, unsigned int> ids_by_content_;
+    std::unordered_map<unsigned int, entry> entries_;
+
+    static std::uint64_t make_content_key(std::uint64_t content_hash, const model_params& params, bool gamma);
+    unsigned int add_reference(unsigned int texture_id, const std::string& key);
+    template <typename Upload>
+    unsigned int acquire_content(const std::string& filename, const model_params& params, bool gamma,
+                                 std::uint64_t content_hash, Upload upload);
+};
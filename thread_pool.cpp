@@ -0,0 +1,72 @@
+﻿#include "thread_pool.h"
+
+namespace
+{
+    size_t shared_thread_count = 0;
+    thread_local const thread_pool* current_worker_pool = nullptr;
+}
+
+thread_pool::thread_pool(size_t thread_count) : stopping_(false)
+{
+    if (thread_count == 0)
+        thread_count = 1;
+
+    workers_.reserve(thread_count);
+    for (size_t i = 0; i < thread_count; ++i)
+        workers_.emplace_back([this] { run_worker(); });
+}
+
+thread_pool::~thread_pool()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stopping_ = true;
+    }
+    condition_.notify_all();
+
+    for (auto& worker : workers_)
+        worker.join();
+}
+
+size_t thread_pool::get_thread_count() const
+{
+    return workers_.size();
+}
+
+bool thread_pool::is_worker_thread() const
+{
+    return current_worker_pool == this;
+}
+
+thread_pool& thread_pool::shared()
+{
+    static thread_pool pool(shared_thread_count != 0 ? shared_thread_count : std::thread::hardware_concurrency());
+    return pool;
+}
+
+void thread_pool::set_shared_thread_count(const size_t thread_count)
+{
+    shared_thread_count = thread_count;
+}
+
+void thread_pool::run_worker()
+{
+    current_worker_pool = this;
+
+    while (true)
+    {
+        std::function<void()> job;
+
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            condition_.wait(lock, [this] { return stopping_ || !jobs_.empty(); });
+            if (stopping_ && jobs_.empty())
+                return;
+
+            job = std::move(jobs_.front());
+            jobs_.pop();
+        }
+
+        job();
+    }
+}
@@ -0,0 +1,89 @@
+﻿#pragma once
+#include <algorithm>
+#include <condition_variable>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <queue>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+// Fixed set of worker threads running queued jobs in submission order.
+class thread_pool
+{
+public:
+    explicit thread_pool(size_t thread_count);
+    ~thread_pool();
+
+    thread_pool(const thread_pool&) = delete;
+    thread_pool& operator=(const thread_pool&) = delete;
+
+    template <typename F>
+    auto submit(F&& job) -> std::future<std::invoke_result_t<std::decay_t<F>>>;
+
+    // Runs body(begin, end) on consecutive ranges covering [0, count), one per worker plus one on the calling
+    // thread, and returns once all of them are done. Called from one of the pool's own workers it runs everything
+    // inline instead, since waiting there for other jobs could deadlock the pool.
+    template <typename F>
+    void parallel_for(size_t count, F&& body);
+
+    size_t get_thread_count() const;
+    bool is_worker_thread() const;
+
+    // pool shared by all asset loading, created on first use
+    static thread_pool& shared();
+    // 0 picks one worker per hardware thread; only has an effect before the first call to shared()
+    static void set_shared_thread_count(size_t thread_count);
+
+private:
+    std::vector<std::thread> workers_;
+    std::queue<std::function<void()>> jobs_;
+    std::mutex mutex_;
+    std::condition_variable condition_;
+    bool stopping_;
+
+    void run_worker();
+};
+
+template <typename F>
+auto thread_pool::submit(F&& job) -> std::future<std::invoke_result_t<std::decay_t<F>>>
+{
+    using result_type = std::invoke_result_t<std::decay_t<F>>;
+
+    auto task = std::make_shared<std::packaged_task<result_type()>>(std::forward<F>(job));
+    auto future = task->get_future();
+
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        jobs_.emplace([task] { (*task)(); });
+    }
+    condition_.notify_one();
+
+    return future;
+}
+
+template <typename F>
+void thread_pool::parallel_for(const size_t count, F&& body)
+{
+    const size_t range_count = is_worker_thread() ? 1 : std::min(count, workers_.size() + 1);
+    if (range_count <= 1)
+    {
+        if (count > 0)
+            body(size_t(0), count);
+        return;
+    }
+
+    const size_t range_size = (count + range_count - 1) / range_count;
+    std::vector<std::future<void>> pending;
+    for (size_t begin = range_size; begin < count; begin += range_size)
+    {
+        const size_t end = std::min(begin + range_size, count);
+        pending.push_back(submit([&body, begin, end] { body(begin, end); }));
+    }
+
+    body(size_t(0), range_size);
+    for (auto& range : pending)
+        range.get();
+}
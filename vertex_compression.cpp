@@ -0,0 +1,192 @@
+﻿#include "vertex_compression.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+namespace
+{
+    std::uint16_t quantize_unorm16(const float value)
+    {
+        const float clamped = std::min(std::max(value, 0.0f), 1.0f);
+        return static_cast<std::uint16_t>(std::lround(clamped * 65535.0f));
+    }
+
+    std::int16_t quantize_snorm16(const float value)
+    {
+        const float clamped = std::min(std::max(value, -1.0f), 1.0f);
+        return static_cast<std::int16_t>(std::lround(clamped * 32767.0f));
+    }
+}
+
+std::uint16_t float_to_half(const float value)
+{
+    std::uint32_t bits;
+    std::memcpy(&bits, &value, sizeof bits);
+
+    const std::uint32_t sign = bits >> 16 & 0x8000;
+    const std::uint32_t magnitude = bits & 0x7FFFFFFF;
+
+    // NaN stays NaN, everything above the largest half overflows to infinity
+    if (magnitude > 0x7F800000)
+        return static_cast<std::uint16_t>(sign | 0x7E00);
+    if (magnitude >= 0x477FF000)
+        return static_cast<std::uint16_t>(sign | 0x7C00);
+
+    // too small for a normal half: shift into a denormal with round to nearest even
+    if (magnitude < 0x38800000)
+    {
+        if (magnitude < 0x33000000)
+            return static_cast<std::uint16_t>(sign);
+
+        const std::uint32_t mantissa = (magnitude & 0x007FFFFF) | 0x00800000;
+        const int shift = 113 - static_cast<int>(magnitude >> 23) + 13;
+        std::uint32_t half = mantissa >> shift;
+        const std::uint32_t remainder = mantissa & ((1u << shift) - 1);
+        const std::uint32_t halfway = 1u << (shift - 1);
+        if (remainder > halfway || (remainder == halfway && (half & 1)))
+            ++half;
+        return static_cast<std::uint16_t>(sign | half);
+    }
+
+    // rebias the exponent and round the mantissa to nearest even
+    std::uint32_t half = (magnitude - 0x38000000) >> 13;
+    const std::uint32_t remainder = magnitude & 0x1FFF;
+    if (remainder > 0x1000 || (remainder == 0x1000 && (half & 1)))
+        ++half;
+    return static_cast<std::uint16_t>(sign | half);
+}
+
+float half_to_float(const std::uint16_t value)
+{
+    const std::uint32_t sign = static_cast<std::uint32_t>(value & 0x8000) << 16;
+    const std::uint32_t exponent = value >> 10 & 0x1F;
+    std::uint32_t mantissa = value & 0x3FF;
+
+    std::uint32_t bits;
+    if (exponent == 0x1F)
+    {
+        bits = sign | 0x7F800000 | mantissa << 13;
+    }
+    else if (exponent != 0)
+    {
+        bits = sign | (exponent + 112) << 23 | mantissa << 13;
+    }
+    else if (mantissa == 0)
+    {
+        bits = sign;
+    }
+    else
+    {
+        // denormal half, normalize it for the float
+        std::uint32_t float_exponent = 113;
+        while ((mantissa & 0x400) == 0)
+        {
+            mantissa <<= 1;
+            --float_exponent;
+        }
+        bits = sign | float_exponent << 23 | (mantissa & 0x3FF) << 13;
+    }
+
+    float result;
+    std::memcpy(&result, &bits, sizeof result);
+    return result;
+}
+
+glm::vec2 encode_octahedral(const glm::vec3 normal)
+{
+    const float sum = std::abs(normal.x) + std::abs(normal.y) + std::abs(normal.z);
+    if (sum == 0.0f)
+        return glm::vec2(0.0f, 0.0f);
+
+    glm::vec2 result(normal.x / sum, normal.y / sum);
+    if (normal.z < 0.0f)
+    {
+        const glm::vec2 folded((1.0f - std::abs(result.y)) * (result.x >= 0.0f ? 1.0f : -1.0f),
+                               (1.0f - std::abs(result.x)) * (result.y >= 0.0f ? 1.0f : -1.0f));
+        result = folded;
+    }
+
+    return result;
+}
+
+glm::vec3 decode_octahedral(const glm::vec2 encoded)
+{
+    glm::vec3 normal(encoded.x, encoded.y, 1.0f - std::abs(encoded.x) - std::abs(encoded.y));
+    if (normal.z < 0.0f)
+    {
+        normal.x = (1.0f - std::abs(encoded.y)) * (encoded.x >= 0.0f ? 1.0f : -1.0f);
+        normal.y = (1.0f - std::abs(encoded.x)) * (encoded.y >= 0.0f ? 1.0f : -1.0f);
+    }
+    return normalize(normal);
+}
+
+glm::vec3 decompress_position(const compact_vertex& vertex, const glm::vec3 position_offset,
+                              const glm::vec3 position_scale)
+{
+    const glm::vec3 normalized(vertex.position[0] / 65535.0f, vertex.position[1] / 65535.0f,
+                               vertex.position[2] / 65535.0f);
+    return position_offset + position_scale * normalized;
+}
+
+vertex decompress_vertex(const compact_vertex& vertex, const glm::vec3 position_offset,
+                         const glm::vec3 position_scale)
+{
+    ::vertex result;
+    result.position = decompress_position(vertex, position_offset, position_scale);
+    result.normal = decode_octahedral(glm::vec2(std::max(vertex.normal[0] / 32767.0f, -1.0f),
+                                                std::max(vertex.normal[1] / 32767.0f, -1.0f)));
+    result.tex_coords = glm::vec2(half_to_float(vertex.tex_coords[0]), half_to_float(vertex.tex_coords[1]));
+    return result;
+}
+
+void compress_mesh(mesh_data& mesh_data)
+{
+    const auto& vertices = mesh_data.vertices;
+    if (vertices.empty())
+        return;
+
+    glm::vec3 bounds_min = vertices[0].position;
+    glm::vec3 bounds_max = vertices[0].position;
+    for (const auto& vertex : vertices)
+    {
+        bounds_min = min(bounds_min, vertex.position);
+        bounds_max = max(bounds_max, vertex.position);
+    }
+
+    const glm::vec3 extent = bounds_max - bounds_min;
+    const auto inverse_extent = [](const float value) { return value > 0.0f ? 1.0f / value : 0.0f; };
+    const glm::vec3 inverse_scale(inverse_extent(extent.x), inverse_extent(extent.y), inverse_extent(extent.z));
+
+    auto& compact_vertices = mesh_data.compact_vertices;
+    compact_vertices.resize(vertices.size());
+    for (size_t i = 0; i < vertices.size(); ++i)
+    {
+        const auto& vertex = vertices[i];
+        auto& compact = compact_vertices[i];
+
+        const glm::vec3 normalized_position = (vertex.position - bounds_min) * inverse_scale;
+        compact.position[0] = quantize_unorm16(normalized_position.x);
+        compact.position[1] = quantize_unorm16(normalized_position.y);
+        compact.position[2] = quantize_unorm16(normalized_position.z);
+        compact.padding = 0;
+
+        const glm::vec2 normal = encode_octahedral(vertex.normal);
+        compact.normal[0] = quantize_snorm16(normal.x);
+        compact.normal[1] = quantize_snorm16(normal.y);
+
+        compact.tex_coords[0] = float_to_half(vertex.tex_coords.x);
+        compact.tex_coords[1] = float_to_half(vertex.tex_coords.y);
+    }
+
+    mesh_data.position_offset = bounds_min;
+    mesh_data.position_scale = extent;
+
+    if (vertices.size() <= max_short_index_vertex_count)
+    {
+        mesh_data.short_indices.assign(mesh_data.indices.begin(), mesh_data.indices.end());
+        mesh_data.indices = std::vector<unsigned int>();
+    }
+
+    mesh_data.vertices = std::vector<vertex>();
+}
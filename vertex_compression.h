@@ -0,0 +1,21 @@
+﻿#pragma once
+#include <cstdint>
+
+#include "mesh.h"
+
+// largest vertex count that can still be addressed with 16-bit indices
+constexpr size_t max_short_index_vertex_count = 65536;
+
+std::uint16_t float_to_half(float value);
+float half_to_float(std::uint16_t value);
+// maps a unit vector onto the octahedron and unfolds it into [-1, 1]^2
+glm::vec2 encode_octahedral(glm::vec3 normal);
+glm::vec3 decode_octahedral(glm::vec2 encoded);
+
+// the inverse of compress_mesh() for one vertex, exact up to the quantization
+glm::vec3 decompress_position(const compact_vertex& vertex, glm::vec3 position_offset, glm::vec3 position_scale);
+vertex decompress_vertex(const compact_vertex& vertex, glm::vec3 position_offset, glm::vec3 position_scale);
+
+// Converts the mesh to compact_vertex and, if it has few enough vertices, to 16-bit indices.
+// Positions are quantized against the mesh bounds, which end up in position_offset/position_scale.
+void compress_mesh(mesh_data& mesh_data);